@@ -1,12 +1,23 @@
 #ifndef BASIC_POLY_UNION_HPP
 #define BASIC_POLY_UNION_HPP
 
+#include <concepts>
 #include <type_traits>
+#include <utility>
 
-#include "open_storage.hpp"
 #include "polymorphic_movable.hpp"
 #include "polymorphic_copyable.hpp"
 
+// Number of types of storages that track the position of the type of their
+// value among a fixed list, e.g., variant_storage, and 0 for all other
+// storages.
+template <typename StorageType>
+int constexpr storage_type_count = 0;
+
+template <typename StorageType>
+requires requires { StorageType::type_count; }
+int constexpr storage_type_count<StorageType> = StorageType::type_count;
+
 /**
  * basic_poly_union is a wrapper for accessing a subclass via its base pointer
  * polymorphically.  The storage type determines how the subclass is
@@ -28,7 +39,11 @@
  *
  * By default basic_poly_union is not default constructible.  However, if a
  * default-constructible type is given as a template argument such a
- * constructor will be available.
+ * constructor will be available.  The optional special member functions are
+ * selected with requires clauses, so there is only a single class template.
+ *
+ * All member functions are constexpr, so storage types that support constant
+ * evaluation, e.g., variant_storage, may be used at compile-time.
  *
  * Constructors and assignment operators for the concrete types are harder to
  * implement since the concrete type is not known.  Depending on whether the
@@ -44,40 +59,135 @@
 template <typename Base, int N, typename StorageType, typename DefaultConstructType = void, bool MoveConstructible = std::derived_from<Base, polymorphic_movable>, bool CopyConstructible = std::derived_from<Base, polymorphic_copyable>>
 struct basic_poly_union
 {
-    // Specializations are defined through basic_poly_union_macro_helper.hpp
-};
+    basic_poly_union(basic_poly_union &&) requires MoveConstructible = default;
+    basic_poly_union & operator=(basic_poly_union &&) requires MoveConstructible = default;
+
+    basic_poly_union(basic_poly_union const &) requires CopyConstructible = default;
+    basic_poly_union & operator=(basic_poly_union const &) requires CopyConstructible = default;
+
+    constexpr void swap(basic_poly_union & other) requires MoveConstructible
+    {
+        storage_.swap(other.storage_);
+    }
+
+    friend constexpr void swap(basic_poly_union & a, basic_poly_union & b) requires MoveConstructible
+    {
+        a.swap(b);
+    }
+
+    constexpr basic_poly_union() requires (!std::is_void_v<DefaultConstructType>)
+        : storage_(std::type_identity<DefaultConstructType>{})
+    {
+    }
+
+    template <typename Derived, typename... Args>
+    requires std::derived_from<Derived, Base>
+    constexpr basic_poly_union(std::type_identity<Derived> w, Args &&... args)
+        : storage_(w, std::forward<Args>(args)...)
+    {
+    }
+
+    template <typename Derived>
+    requires std::derived_from<Derived, Base> && std::copy_constructible<Derived>
+    constexpr basic_poly_union(Derived const & v)
+        : storage_(std::type_identity<Derived>{}, v)
+    {
+    }
+
+    template <typename Derived>
+    requires std::derived_from<Derived, Base> &&  std::move_constructible<Derived>
+    constexpr basic_poly_union(Derived && v)
+        : storage_(std::type_identity<Derived>{}, std::forward<Derived>(v))
+    {
+    }
+
+    template <typename Derived, typename... Args>
+    requires std::derived_from<Derived, Base>
+    constexpr decltype(auto) emplace(Args &&... args)
+    {
+        return *storage_.template emplace<Derived>(std::forward<Args>(args)...);
+    }
+
+    // call emplace with copy constructor
+    template <typename Derived>
+    requires std::derived_from<Derived, Base> && std::copy_constructible<Derived>
+    constexpr decltype(auto) insert_copy(Derived const & derived)
+    {
+        return emplace<Derived>(derived);
+    }
+
+    constexpr Base * pointer()
+    {
+        return storage_.pointer();
+    }
 
-#define IS_DEFINING_MOVE(n) (n & 1) != 0
-#define IS_DEFINING_COPY(n) (n & 2) != 0
-#define IS_DEFINING_DEFAULT_CONSTRUCTOR(n) (n & 4) != 0
-
-#define PARAM 0
-#include "basic_poly_union_macro_helper.hpp"
-#undef PARAM
-#define PARAM 1
-#include "basic_poly_union_macro_helper.hpp"
-#undef PARAM
-#define PARAM 2
-#include "basic_poly_union_macro_helper.hpp"
-#undef PARAM
-#define PARAM 3
-#include "basic_poly_union_macro_helper.hpp"
-#undef PARAM
-#define PARAM 4
-#include "basic_poly_union_macro_helper.hpp"
-#undef PARAM
-#define PARAM 5
-#include "basic_poly_union_macro_helper.hpp"
-#undef PARAM
-#define PARAM 6
-#include "basic_poly_union_macro_helper.hpp"
-#undef PARAM
-#define PARAM 7
-#include "basic_poly_union_macro_helper.hpp"
-#undef PARAM
-
-#undef IS_DEFINING_MOVE
-#undef IS_DEFINING_COPY
-#undef IS_DEFINING_DEFAULT_CONSTRUCTOR
+    constexpr Base const * pointer() const
+    {
+        return storage_.pointer();
+    }
+
+    constexpr Base * operator->()
+    {
+        return pointer();
+    }
+
+    constexpr Base const * operator->() const
+    {
+        return pointer();
+    }
+
+    constexpr Base & get()
+    {
+        return *pointer();
+    }
+
+    constexpr Base const & get() const
+    {
+        return *pointer();
+    }
+
+    // Interface subobject of the value, if the storage type keeps track of
+    // several interfaces, e.g., multi_interface_storage
+    template <typename Interface>
+    constexpr Interface & get()
+    requires requires (StorageType & s) { s.template get<Interface>(); }
+    {
+        return *storage_.template get<Interface>();
+    }
+
+    template <typename Interface>
+    constexpr Interface const & get() const
+    requires requires (StorageType const & s) { s.template get<Interface>(); }
+    {
+        return *storage_.template get<Interface>();
+    }
+
+    static int constexpr type_count = storage_type_count<StorageType>;
+
+    // position of the current type for storages that track it, i.e., in
+    // [0, type_count) for variant_storage and the id from type_registry for
+    // registered_storage
+    constexpr int index() const
+    requires requires (StorageType const & s) { s.index(); }
+    {
+        return storage_.index();
+    }
+
+    // Access to the storage for algorithms that depend on its type, e.g.,
+    // compact_forwarded.
+    constexpr StorageType & storage()
+    {
+        return storage_;
+    }
+
+    constexpr StorageType const & storage() const
+    {
+        return storage_;
+    }
+
+    private:
+
+    StorageType storage_;
+};
 
 #endif
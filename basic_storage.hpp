@@ -1,11 +1,37 @@
 #ifndef BASIC_STORAGE_HPP
 #define BASIC_STORAGE_HPP
 
+#include <concepts>
+#include <cstring>
+#include <memory>
+#include <type_traits>
 #include <utility>
 
 #include "polymorphic_movable.hpp"
 #include "polymorphic_copyable.hpp"
 
+// Whether the Base subobject of every Derived is at its start.  The offset
+// of a base of a polymorphic class is not a constant expression, but the
+// address of a base in storage that was allocated during constant
+// evaluation may be compared with the address of the storage.  Virtual bases
+// are not at a constant offset, so this is not a constant expression for
+// them and the concept below is not satisfied.
+template <typename Base, typename Derived>
+consteval bool is_base_at_start()
+{
+    std::allocator<Derived> allocator;
+    Derived * derived = allocator.allocate(1);
+    Base * base = derived;
+    bool const result = static_cast<void *>(base) == static_cast<void *>(derived);
+    allocator.deallocate(derived, 1);
+    return result;
+}
+
+template <typename Derived, typename Base>
+concept base_at_start = std::derived_from<Derived, Base>
+    && requires { typename std::bool_constant<is_base_at_start<Base, Derived>()>; }
+    && is_base_at_start<Base, Derived>();
+
 template <int N, typename Base>
 struct basic_storage
 {
@@ -14,6 +40,10 @@ struct basic_storage
     template <typename T, typename... Args>
     T * unsafe_construct(Args &&... args)
     {
+        // The value is accessed through a Base pointer to the start of the
+        // buffer.
+        static_assert(!std::is_base_of_v<Base, T> || base_at_start<T, Base>,
+                      "Base has to be at the start of T, use multi_poly_union or forwarding_poly_union otherwise");
         return ::new (buffer_) T(std::forward<Args>(args)...);
     }
 
@@ -50,6 +80,21 @@ struct basic_storage
         unsafe_destroy<Base>();
     }
 
+    // Exchange the object representations of both buffers.
+    void unsafe_swap_bytes(basic_storage & other)
+    {
+        std::byte tmp[N];
+        std::memcpy(tmp, buffer_, N);
+        std::memcpy(buffer_, other.buffer_, N);
+        std::memcpy(other.buffer_, tmp, N);
+    }
+
+    // Assumption: Buffer is not initialized or destructor has been called before.
+    void unsafe_copy_bytes(std::byte const * bytes)
+    {
+        std::memcpy(buffer_, bytes, N);
+    }
+
     void move_construct_in_place_base(Base * other)
     {
         // Type information would be necessary to determine if we could move
@@ -57,7 +102,7 @@ struct basic_storage
         if constexpr (std::is_base_of_v<polymorphic_movable, Base>)
         {
             // Assumption: Buffer is not initialized or constructor has been called before.
-            polymorphic_movable * m = reinterpret_cast<polymorphic_movable *>(other);
+            polymorphic_movable * m = static_cast<polymorphic_movable *>(other);
             m->polymorphic_move_construct_in_place(buffer_);
         }
         else
@@ -72,7 +117,7 @@ struct basic_storage
         if constexpr (std::is_base_of_v<polymorphic_copyable, Base>)
         {
             // Assumption: Buffer is not initialized or constructor has been called before.
-            polymorphic_copyable const * c = reinterpret_cast<polymorphic_copyable const *>(other);
+            polymorphic_copyable const * c = static_cast<polymorphic_copyable const *>(other);
             c->polymorphic_copy_construct_in_place(storage);
         }
         else
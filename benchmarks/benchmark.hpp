@@ -0,0 +1,29 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <algorithm>
+#include <chrono>
+
+// Lowest wall-clock time of runs calls of f in milliseconds.
+template <typename F>
+double best_of_ms(int runs, F f)
+{
+    double best = 0;
+    for (int i = 0; i < runs; ++i)
+    {
+        auto const start = std::chrono::steady_clock::now();
+        f();
+        double const ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        best = i == 0 ? ms : std::min(best, ms);
+    }
+    return best;
+}
+
+// Keeps the compiler from removing the computation of value.
+template <typename T>
+void do_not_optimize(T const & value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+#endif
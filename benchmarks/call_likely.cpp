@@ -0,0 +1,248 @@
+// Calls a function on shuffled poly_union elements of three final shapes,
+// with virtual calls and with call_likely for the two most frequent ones,
+// for two mixes of the shapes.  The function either makes a single virtual
+// call or several on the same value.  Then measures the cost of profiling
+// call sites with profile_call_sites from one and from four threads.
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "poly_union.hpp"
+#include "call_likely.hpp"
+#include "benchmark.hpp"
+
+struct shape : polymorphic_movable
+{
+    virtual ~shape() = default;
+    virtual double area() const = 0;
+    virtual double perimeter() const = 0;
+    virtual int sides() const = 0;
+};
+
+struct square final : shape
+{
+    square(double a) : a(a) {}
+
+    double area() const override
+    {
+        return a * a;
+    }
+
+    double perimeter() const override
+    {
+        return 4 * a;
+    }
+
+    int sides() const override
+    {
+        return 4;
+    }
+
+    DEFINE_POLYMORPHIC_MOVE()
+
+    double a;
+};
+
+struct triangle final : shape
+{
+    triangle(double a) : a(a) {}
+
+    double area() const override
+    {
+        return 0.433 * a * a;
+    }
+
+    double perimeter() const override
+    {
+        return 3 * a;
+    }
+
+    int sides() const override
+    {
+        return 3;
+    }
+
+    DEFINE_POLYMORPHIC_MOVE()
+
+    double a;
+};
+
+struct hexagon final : shape
+{
+    hexagon(double a) : a(a) {}
+
+    double area() const override
+    {
+        return 2.598 * a * a;
+    }
+
+    double perimeter() const override
+    {
+        return 6 * a;
+    }
+
+    int sides() const override
+    {
+        return 6;
+    }
+
+    DEFINE_POLYMORPHIC_MOVE()
+
+    double a;
+};
+
+typedef poly_union<shape, 32> shape_union;
+
+// Percentages of squares and triangles, the rest are hexagons.
+std::vector<shape_union> make_shapes(std::size_t count, int squares, int triangles)
+{
+    std::mt19937 random(42);
+    std::vector<shape_union> shapes;
+    shapes.reserve(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        int const percent = static_cast<int>(i * 100 / count);
+        double const a = static_cast<double>(i % 10 + 1);
+        if (percent < squares)
+        {
+            shapes.emplace_back(std::type_identity<square>{}, a);
+        }
+        else if (percent < squares + triangles)
+        {
+            shapes.emplace_back(std::type_identity<triangle>{}, a);
+        }
+        else
+        {
+            shapes.emplace_back(std::type_identity<hexagon>{}, a);
+        }
+    }
+    std::shuffle(shapes.begin(), shapes.end(), random);
+    return shapes;
+}
+
+struct area_of
+{
+    template <typename S>
+    double operator()(S const & s) const
+    {
+        return s.area();
+    }
+};
+
+struct weighted_perimeter
+{
+    template <typename S>
+    double operator()(S const & s) const
+    {
+        double result = s.area();
+        for (int i = 0; i < s.sides(); ++i)
+        {
+            result += i * s.perimeter();
+        }
+        return result;
+    }
+};
+
+template <typename F>
+double measure_virtual(std::vector<shape_union> const & shapes, int runs, F f)
+{
+    return best_of_ms(runs, [&shapes, f]
+    {
+        double sum = 0;
+        for (shape_union const & s : shapes)
+        {
+            sum += f(s.get());
+        }
+        do_not_optimize(sum);
+    });
+}
+
+template <typename F>
+double measure_likely(std::vector<shape_union> const & shapes, int runs, F f)
+{
+    return best_of_ms(runs, [&shapes, f]
+    {
+        double sum = 0;
+        for (shape_union const & s : shapes)
+        {
+            sum += call_likely<square, triangle>(s, f);
+        }
+        do_not_optimize(sum);
+    });
+}
+
+// Nanoseconds per call of call_likely on every thread, with or without
+// profiling.
+template <bool Profiled>
+double measure_profiling(std::vector<shape_union> const & shapes, int threads, int rounds)
+{
+    auto work = [&shapes, rounds]
+    {
+        double sum = 0;
+        for (int r = 0; r < rounds; ++r)
+        {
+            for (shape_union const & s : shapes)
+            {
+                if constexpr (Profiled)
+                {
+                    sum += call_likely<square>(s, area_of{}, profile_call_sites);
+                }
+                else
+                {
+                    sum += call_likely<square>(s, area_of{});
+                }
+            }
+        }
+        do_not_optimize(sum);
+    };
+    double const ms = best_of_ms(3, [&work, threads]
+    {
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t)
+        {
+            workers.emplace_back(work);
+        }
+        for (std::thread & w : workers)
+        {
+            w.join();
+        }
+    });
+    return ms * 1e6 / (static_cast<double>(shapes.size()) * rounds * threads);
+}
+
+int main()
+{
+    struct mix
+    {
+        char const * name;
+        int squares;
+        int triangles;
+    };
+
+    std::printf("%-10s %-9s %-18s %12s %12s\n", "values", "mix", "function", "virtual", "call_likely");
+    for (std::size_t count : { std::size_t(10000), std::size_t(10000000) })
+    {
+        int const runs = count <= 10000 ? 200 : 3;
+        for (mix m : { mix { "95/4/1", 95, 4 }, mix { "60/35/5", 60, 35 } })
+        {
+            std::vector<shape_union> const shapes = make_shapes(count, m.squares, m.triangles);
+            std::printf("%-10zu %-9s %-18s %9.3f ms %9.3f ms\n", count, m.name, "area",
+                        measure_virtual(shapes, runs, area_of{}), measure_likely(shapes, runs, area_of{}));
+            std::printf("%-10zu %-9s %-18s %9.3f ms %9.3f ms\n", count, m.name, "weighted_perimeter",
+                        measure_virtual(shapes, runs, weighted_perimeter{}), measure_likely(shapes, runs, weighted_perimeter{}));
+        }
+    }
+
+    std::printf("\n%u hardware threads, 10k values, call_likely<square> of area\n", std::thread::hardware_concurrency());
+    std::printf("%-8s %18s %18s\n", "threads", "without profiling", "profile_call_sites");
+    std::vector<shape_union> const shapes = make_shapes(10000, 95, 4);
+    for (int threads : { 1, 4 })
+    {
+        int const rounds = 400 / threads;
+        std::printf("%-8d %15.2f ns %15.2f ns\n", threads,
+                    measure_profiling<false>(shapes, threads, rounds), measure_profiling<true>(shapes, threads, rounds));
+    }
+}
@@ -0,0 +1,69 @@
+#!/usr/bin/env bash
+#
+# Measures how long it takes to compile a closed_poly_union of many types.
+#
+# For every count a translation unit with that many subclasses is generated,
+# which constructs, emplaces, moves, and copies a closed_poly_union of all of
+# them.  It is compiled with -fsyntax-only RUNS times.  The lowest CPU time
+# (user and system) and the highest peak resident memory of the compiler are
+# reported, both measured by measure.cpp.
+#
+# Usage: benchmarks/compile_time.sh [count...]
+# The compiler and flags may be set with CXX and CXXFLAGS, the headers to
+# measure with POLY_UNION_INCLUDE, e.g., a checkout of an older commit.
+
+set -euo pipefail
+
+CXX=${CXX:-g++}
+CXXFLAGS=${CXXFLAGS:--std=c++20}
+RUNS=${RUNS:-3}
+COUNTS=("$@")
+if [ ${#COUNTS[@]} -eq 0 ]; then
+    COUNTS=(10 100 500)
+fi
+
+BENCHMARKS=$(cd "$(dirname "$0")" && pwd)
+INCLUDE=${POLY_UNION_INCLUDE:-$(dirname "$BENCHMARKS")}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+"$CXX" -O2 "$BENCHMARKS/measure.cpp" -o "$WORK/measure"
+
+generate()
+{
+    local count=$1
+    local types=""
+
+    echo '#include <new>'
+    echo '#include "closed_poly_union.hpp"'
+    echo 'struct B : polymorphic_movable, polymorphic_copyable { virtual ~B() = default; virtual int f() const = 0; };'
+    for ((i = 0; i < count; ++i)); do
+        echo "struct d$i : B { char c[$((i % 32 + 1))]; int f() const override { return $i; } DEFINE_POLYMORPHIC_MOVE() DEFINE_POLYMORPHIC_COPY() };"
+        types+="${types:+,}d$i"
+    done
+    echo "typedef closed_poly_union<B, $types> U;"
+    echo "int main()"
+    echo "{"
+    echo "    U u(std::type_identity<d$((count - 1))>{});"
+    echo "    u.emplace<d$((count / 2))>();"
+    echo "    U v = std::move(u);"
+    echo "    U w = v;"
+    echo "    return w->f();"
+    echo "}"
+}
+
+# Prints the lowest CPU time and the highest peak memory of RUNS compilations.
+measure_compilation()
+{
+    local file=$1
+    for ((run = 0; run < RUNS; ++run)); do
+        "$WORK/measure" $CXX $CXXFLAGS -fsyntax-only -I"$INCLUDE" "$file"
+    done | awk 'NR == 1 || $1 < seconds { seconds = $1 } $2 > memory { memory = $2 } END { printf "%.2f s, %d MB", seconds, memory }'
+}
+
+echo "$($CXX --version | head -n 1), $CXXFLAGS, $INCLUDE, best of $RUNS"
+for count in "${COUNTS[@]}"; do
+    file="$WORK/types_$count.cpp"
+    generate "$count" > "$file"
+    echo "$count types: $(measure_compilation "$file")"
+done
@@ -0,0 +1,160 @@
+// Measures the read throughput of concurrent_poly_union with 1 to 64 reader
+// threads while a writer tries to replace the value every millisecond,
+// compared to a poly_union guarded by std::mutex and by std::shared_mutex.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+#include "poly_union.hpp"
+#include "concurrent_poly_union.hpp"
+
+struct reading : polymorphic_movable
+{
+    virtual ~reading() = default;
+    virtual long value() const = 0;
+};
+
+struct temperature : reading
+{
+    temperature(long v) : v(v) {}
+
+    long value() const override
+    {
+        return v;
+    }
+
+    DEFINE_POLYMORPHIC_MOVE()
+
+    long v;
+};
+
+struct pressure : reading
+{
+    pressure(long v) : v(v) {}
+
+    long value() const override
+    {
+        return -v;
+    }
+
+    DEFINE_POLYMORPHIC_MOVE()
+
+    long v;
+};
+
+std::chrono::milliseconds constexpr duration(500);
+
+struct concurrent_slot
+{
+    long read() const
+    {
+        return u.read([](reading const & r) { return r.value(); });
+    }
+
+    template <typename Derived>
+    void write(long v)
+    {
+        u.emplace<Derived>(v);
+    }
+
+    concurrent_poly_union<reading, 24> u { std::type_identity<temperature>{}, 0 };
+};
+
+template <typename Mutex, typename ReadLock>
+struct locked_slot
+{
+    long read() const
+    {
+        ReadLock lock(mutex);
+        return u->value();
+    }
+
+    template <typename Derived>
+    void write(long v)
+    {
+        std::lock_guard<Mutex> lock(mutex);
+        u.emplace<Derived>(v);
+    }
+
+    mutable Mutex mutex;
+    poly_union<reading, 24> u { std::type_identity<temperature>{}, 0 };
+};
+
+struct result
+{
+    // Million reads per second of all readers together.
+    double reads;
+    // Replacements per second, at most 1000.
+    double writes;
+};
+
+// The run is ended by a timer rather than by the writer, which may starve
+// behind the readers.
+template <typename Slot>
+result measure(int threads)
+{
+    Slot slot;
+    std::atomic<bool> done { false };
+    std::atomic<long> reads { 0 };
+    std::vector<std::thread> readers;
+    for (int i = 0; i < threads; ++i)
+    {
+        readers.emplace_back([&]
+        {
+            long count = 0;
+            long sum = 0;
+            while (!done.load(std::memory_order_relaxed))
+            {
+                sum += slot.read();
+                ++count;
+            }
+            reads.fetch_add(count + (sum == 42 ? 1 : 0), std::memory_order_relaxed);
+        });
+    }
+
+    long writes = 0;
+    std::thread writer([&]
+    {
+        for (; !done.load(std::memory_order_relaxed); ++writes)
+        {
+            if (writes % 2 == 0)
+            {
+                slot.template write<temperature>(writes);
+            }
+            else
+            {
+                slot.template write<pressure>(writes);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    auto const start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(duration);
+    done = true;
+    double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    writer.join();
+    for (std::thread & t : readers)
+    {
+        t.join();
+    }
+    return { reads.load() / seconds / 1e6, writes / seconds };
+}
+
+int main()
+{
+    std::printf("%u hardware threads, million reads per second (replacements per second)\n", std::thread::hardware_concurrency());
+    std::printf("threads  concurrent_poly_union         mutex   shared_mutex\n");
+    for (int threads = 1; threads <= 64; threads *= 2)
+    {
+        result const c = measure<concurrent_slot>(threads);
+        result const m = measure<locked_slot<std::mutex, std::lock_guard<std::mutex>>>(threads);
+        result const s = measure<locked_slot<std::shared_mutex, std::shared_lock<std::shared_mutex>>>(threads);
+        std::printf("%7d  %14.1f (%4.0f)  %6.1f (%4.0f)  %6.1f (%4.0f)\n", threads, c.reads, c.writes, m.reads, m.writes, s.reads, s.writes);
+    }
+}
@@ -0,0 +1,110 @@
+// Builds many values with few distinct ones as poly_union and as
+// interned_poly_union and compares the time and the resident memory, then
+// interns distinct values from several threads.
+
+#include <cstdio>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "poly_union.hpp"
+#include "interned_poly_union.hpp"
+#include "benchmark.hpp"
+
+struct rule : polymorphic_movable, polymorphic_hashable
+{
+    virtual ~rule() = default;
+    virtual int priority() const = 0;
+};
+
+struct int_rule : rule
+{
+    int_rule(int key) : key(key) {}
+
+    int priority() const override
+    {
+        return key;
+    }
+
+    friend std::size_t hash_value(int_rule const & r)
+    {
+        return std::hash<int>()(r.key);
+    }
+
+    bool operator==(int_rule const & other) const
+    {
+        return key == other.key;
+    }
+
+    DEFINE_POLYMORPHIC_MOVE()
+    DEFINE_POLYMORPHIC_HASH()
+
+    int key;
+    char payload[28] = {};
+};
+
+// Resident memory of this process in MB.
+double resident_mb()
+{
+    std::ifstream statm("/proc/self/statm");
+    std::size_t pages = 0;
+    std::size_t resident = 0;
+    statm >> pages >> resident;
+    return resident * static_cast<double>(sysconf(_SC_PAGESIZE)) / (1 << 20);
+}
+
+template <typename Union>
+void build(char const * name, std::size_t count, int distinct)
+{
+    double const before = resident_mb();
+    std::vector<Union> values;
+    double const ms = best_of_ms(1, [&]
+    {
+        values.reserve(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            values.emplace_back(std::type_identity<int_rule>{}, static_cast<int>(i % distinct));
+        }
+    });
+    std::printf("%-28s %6.1f MB resident, %6.1f ms to build\n", name, resident_mb() - before, ms);
+}
+
+int main()
+{
+    std::size_t const count = 2 << 20;
+    int const distinct = 1000;
+    std::printf("%zu values, %d distinct\n", count, distinct);
+    build<poly_union<rule, 48>>("poly_union<rule, 48>", count, distinct);
+    build<interned_poly_union<rule>>("interned_poly_union<rule>", count, distinct);
+
+    // Every thread interns its own distinct values, so threads only contend
+    // if their values share a shard.
+    std::size_t const per_thread = 1 << 18;
+    std::printf("\n%zu distinct values per thread, %u hardware threads\n", per_thread, std::thread::hardware_concurrency());
+    for (int threads : { 1, 2, 4, 8 })
+    {
+        double const ms = best_of_ms(3, [threads, per_thread]
+        {
+            std::vector<std::thread> workers;
+            for (int t = 0; t < threads; ++t)
+            {
+                workers.emplace_back([t, per_thread]
+                {
+                    std::vector<interned_poly_union<rule>> values;
+                    values.reserve(per_thread);
+                    for (std::size_t i = 0; i < per_thread; ++i)
+                    {
+                        values.emplace_back(std::type_identity<int_rule>{}, static_cast<int>(t * per_thread + i));
+                    }
+                });
+            }
+            for (std::thread & w : workers)
+            {
+                w.join();
+            }
+        });
+        std::printf("%d threads: %6.1f ms, %6.1f ns per value\n", threads, ms, ms * 1e6 / (threads * per_thread));
+    }
+}
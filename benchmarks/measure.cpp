@@ -0,0 +1,44 @@
+// Runs a command and prints the CPU time in seconds, user and system, and
+// the peak resident memory in MB of it and the processes it waited for.
+// Used by compile_time.sh, since GNU time is not always installed.
+
+#include <cstdio>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+int main(int argc, char ** argv)
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "usage: %s command [argument...]\n", argv[0]);
+        return 2;
+    }
+
+    pid_t const pid = ::fork();
+    if (pid < 0)
+    {
+        std::perror("fork");
+        return 2;
+    }
+    if (pid == 0)
+    {
+        ::execvp(argv[1], argv + 1);
+        std::perror(argv[1]);
+        ::_exit(127);
+    }
+
+    int status;
+    rusage usage;
+    if (::wait4(pid, &status, 0, &usage) < 0)
+    {
+        std::perror("wait4");
+        return 2;
+    }
+
+    double const seconds = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+                         + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+    std::printf("%.2f %ld\n", seconds, usage.ru_maxrss / 1024);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
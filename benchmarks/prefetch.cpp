@@ -0,0 +1,104 @@
+// Sums the values of shuffled forwarding_poly_union elements of which a
+// share is forwarded to the heap: with a plain loop, with
+// for_each_prefetched, and with a plain loop after compact_forwarded.
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "forwarding_poly_union.hpp"
+#include "poly_union_algorithm.hpp"
+#include "benchmark.hpp"
+
+struct value_base : polymorphic_movable
+{
+    virtual ~value_base() = default;
+    virtual long value() const = 0;
+};
+
+struct small_value : value_base
+{
+    small_value(int v) : v(v) {}
+
+    long value() const override
+    {
+        return v;
+    }
+
+    DEFINE_POLYMORPHIC_MOVE()
+
+    int v;
+};
+
+struct large_value : value_base
+{
+    large_value(int v) : v{ v } {}
+
+    long value() const override
+    {
+        return v[0];
+    }
+
+    DEFINE_POLYMORPHIC_MOVE()
+
+    long v[8];
+};
+
+typedef forwarding_poly_union<value_base, 16> value_union;
+
+static_assert(sizeof(small_value) <= 16 && sizeof(large_value) > 16);
+
+long plain_sum(std::vector<value_union> const & values)
+{
+    long sum = 0;
+    for (value_union const & v : values)
+    {
+        sum += v->value();
+    }
+    return sum;
+}
+
+int main()
+{
+    std::size_t const count = 4 << 20;
+    int const runs = 5;
+
+    std::printf("%zu elements, best of %d, ms per pass\n", count, runs);
+    for (int spill_percent : { 0, 10, 50, 100 })
+    {
+        std::mt19937 random(42);
+        std::vector<value_union> values;
+        values.reserve(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            if (static_cast<int>(random() % 100) < spill_percent)
+            {
+                values.emplace_back(std::type_identity<large_value>{}, 1);
+            }
+            else
+            {
+                values.emplace_back(std::type_identity<small_value>{}, 1);
+            }
+        }
+        std::shuffle(values.begin(), values.end(), random);
+
+        double const plain = best_of_ms(runs, [&values] { do_not_optimize(plain_sum(values)); });
+        std::printf("spill %3d%%: plain %6.1f", spill_percent, plain);
+        for (std::size_t distance : { 8, 32 })
+        {
+            double const prefetched = best_of_ms(runs, [&values, distance]
+            {
+                long sum = 0;
+                for_each_prefetched(std::as_const(values), [&sum](value_union const & v) { sum += v->value(); }, distance);
+                do_not_optimize(sum);
+            });
+            std::printf(", prefetched %zu ahead %6.1f", distance, prefetched);
+        }
+        poly_arena arena = compact_forwarded(values);
+        double const compacted = best_of_ms(runs, [&values] { do_not_optimize(plain_sum(values)); });
+        std::printf(", compacted %6.1f\n", compacted);
+
+        // The arena has to outlive the values in it.
+        values.clear();
+    }
+}
@@ -0,0 +1,175 @@
+// Schedules events with random time stamps and then runs all of them, with
+// poly_priority_queue and with std::priority_queue of time stamps and
+// std::unique_ptr.  The counts may be given on the command line, a run that
+// would not fit into the available memory is skipped.
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <queue>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "poly_priority_queue.hpp"
+#include "benchmark.hpp"
+
+struct event : polymorphic_movable
+{
+    virtual ~event() = default;
+    virtual long run() const = 0;
+};
+
+struct arrival : event
+{
+    arrival(long id) : id(id) {}
+
+    long run() const override
+    {
+        return id;
+    }
+
+    DEFINE_POLYMORPHIC_MOVE()
+
+    long id;
+};
+
+struct departure : event
+{
+    departure(long id) : id(static_cast<int>(id)), gate(static_cast<int>(id % 7)) {}
+
+    long run() const override
+    {
+        return gate - id;
+    }
+
+    DEFINE_POLYMORPHIC_MOVE()
+
+    int id;
+    int gate;
+};
+
+typedef poly_priority_queue<long, event, 16> event_queue;
+
+typedef std::pair<long, std::unique_ptr<event>> event_pair;
+
+struct later
+{
+    bool operator()(event_pair const & a, event_pair const & b) const
+    {
+        return a.first > b.first;
+    }
+};
+
+std::vector<long> random_times(std::size_t count)
+{
+    std::mt19937_64 random(42);
+    std::uniform_int_distribution<long> time(0, static_cast<long>(count));
+    std::vector<long> result(count);
+    for (long & t : result)
+    {
+        t = time(random);
+    }
+    return result;
+}
+
+double available_mb()
+{
+    return static_cast<double>(sysconf(_SC_AVPHYS_PAGES)) * static_cast<double>(sysconf(_SC_PAGESIZE)) / (1 << 20);
+}
+
+double measure_poly(std::vector<long> const & times, int runs)
+{
+    return best_of_ms(runs, [&times]
+    {
+        event_queue queue;
+        queue.reserve(times.size());
+        for (std::size_t i = 0; i < times.size(); ++i)
+        {
+            if (i % 2 == 0)
+            {
+                queue.emplace<arrival>(times[i], static_cast<long>(i));
+            }
+            else
+            {
+                queue.emplace<departure>(times[i], static_cast<long>(i));
+            }
+        }
+        long sum = 0;
+        while (!queue.empty())
+        {
+            queue.pop_and_run([&sum](long const & time, event & e) { sum += time + e.run(); });
+        }
+        do_not_optimize(sum);
+    });
+}
+
+double measure_std(std::vector<long> const & times, int runs)
+{
+    return best_of_ms(runs, [&times]
+    {
+        std::vector<event_pair> storage;
+        storage.reserve(times.size());
+        std::priority_queue<event_pair, std::vector<event_pair>, later> queue(later{}, std::move(storage));
+        for (std::size_t i = 0; i < times.size(); ++i)
+        {
+            if (i % 2 == 0)
+            {
+                queue.emplace(times[i], std::make_unique<arrival>(static_cast<long>(i)));
+            }
+            else
+            {
+                queue.emplace(times[i], std::make_unique<departure>(static_cast<long>(i)));
+            }
+        }
+        long sum = 0;
+        while (!queue.empty())
+        {
+            sum += queue.top().first + queue.top().second->run();
+            queue.pop();
+        }
+        do_not_optimize(sum);
+    });
+}
+
+int main(int argc, char ** argv)
+{
+    std::vector<std::size_t> counts;
+    for (int i = 1; i < argc; ++i)
+    {
+        counts.push_back(std::strtoul(argv[i], nullptr, 10));
+    }
+    if (counts.empty())
+    {
+        counts = { 1000000, 10000000, 100000000 };
+    }
+
+    // Heap nodes and pairs, plus the allocation of every event, which
+    // takes 32 bytes with glibc.
+    std::size_t constexpr poly_bytes = sizeof(long) + sizeof(std::uint64_t) + 16;
+    std::size_t constexpr std_bytes = sizeof(event_pair) + 32;
+
+    std::printf("%-10s %20s %20s\n", "events", "poly_priority_queue", "std::priority_queue");
+    for (std::size_t count : counts)
+    {
+        std::vector<long> const times = random_times(count);
+        int const runs = count <= 1000000 ? 5 : 1;
+        std::printf("%-10zu", count);
+        for (auto [bytes, measure] : { std::pair { poly_bytes, &measure_poly }, std::pair { std_bytes, &measure_std } })
+        {
+            double const needed_mb = static_cast<double>(count * bytes) / (1 << 20);
+            if (needed_mb > 0.9 * available_mb())
+            {
+                std::printf(" %13s %4.0f MB", "needs", needed_mb);
+            }
+            else
+            {
+                std::printf(" %17.0f ms", measure(times, runs));
+            }
+            std::fflush(stdout);
+        }
+        std::printf("\n");
+    }
+}
@@ -0,0 +1,36 @@
+#!/usr/bin/env bash
+#
+# Builds and runs the benchmarks in this directory, all of them or the ones
+# given by name, e.g., benchmarks/run.sh prefetch.  Every benchmark is a
+# single translation unit that prints its own results.
+#
+# Usage: benchmarks/run.sh [name...]
+# The compiler and flags may be set with CXX and CXXFLAGS.
+
+set -euo pipefail
+
+CXX=${CXX:-g++}
+CXXFLAGS=${CXXFLAGS:--std=c++20 -O2 -DNDEBUG}
+
+BENCHMARKS=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(dirname "$BENCHMARKS")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+NAMES=("$@")
+if [ ${#NAMES[@]} -eq 0 ]; then
+    for file in "$BENCHMARKS"/*.cpp; do
+        name=$(basename "$file" .cpp)
+        if [ "$name" != measure ]; then
+            NAMES+=("$name")
+        fi
+    done
+fi
+
+echo "$($CXX --version | head -n 1), $CXXFLAGS"
+for name in "${NAMES[@]}"; do
+    echo
+    echo "$name"
+    $CXX $CXXFLAGS -pthread -I"$ROOT" "$BENCHMARKS/$name.cpp" -o "$WORK/$name"
+    "$WORK/$name"
+done
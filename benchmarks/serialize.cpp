@@ -0,0 +1,142 @@
+// Serializes and deserializes a run of values whose payload is packed into
+// the chunks in bulk, and the same values with a serializer that writes and
+// reads every member on its own.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "closed_poly_union_serialization.hpp"
+#include "benchmark.hpp"
+
+struct body : polymorphic_movable, polymorphic_copyable
+{
+    virtual ~body() = default;
+    virtual double mass() const = 0;
+};
+
+struct particle : body
+{
+    particle() = default;
+    particle(float x, float y, float z, double m) : x(x), y(y), z(z), m(m) {}
+
+    double mass() const override
+    {
+        return m;
+    }
+
+    friend auto poly_fields(particle & self)
+    {
+        return std::tie(self.x, self.y, self.z, self.m);
+    }
+
+    DEFINE_POLYMORPHIC_MOVE()
+    DEFINE_POLYMORPHIC_COPY()
+
+    float x = 0;
+    float y = 0;
+    float z = 0;
+    double m = 0;
+};
+
+// The same members, serialized one by one.
+struct unpacked_particle : particle
+{
+    using particle::particle;
+
+    DEFINE_POLYMORPHIC_MOVE()
+    DEFINE_POLYMORPHIC_COPY()
+};
+
+template <>
+struct poly_serializer<unpacked_particle>
+{
+    static std::size_t constexpr payload_size = poly_payload_size<particle>();
+
+    template <typename Writer>
+    static void write(Writer & w, unpacked_particle const & v)
+    {
+        poly_serializer<particle>::write(w, v);
+    }
+
+    template <typename Reader, typename Construct>
+    static void read(Reader & r, Construct && construct)
+    {
+        poly_serializer<particle>::read(r, [&construct](particle && p)
+        {
+            construct(p.x, p.y, p.z, p.m);
+        });
+    }
+};
+
+struct string_sink
+{
+    void write(std::byte const * data, std::size_t n)
+    {
+        out.append(reinterpret_cast<char const *>(data), n);
+    }
+
+    std::string & out;
+};
+
+struct string_source
+{
+    std::size_t read_some(std::byte * data, std::size_t n)
+    {
+        std::size_t const count = std::min(n, in.size() - position);
+        std::memcpy(data, in.data() + position, count);
+        position += count;
+        return count;
+    }
+
+    std::size_t size_left()
+    {
+        return in.size() - position;
+    }
+
+    std::string const & in;
+    std::size_t position = 0;
+};
+
+template <typename T>
+void measure(char const * name, std::size_t count)
+{
+    typedef closed_poly_union<body, particle, unpacked_particle> body_union;
+    std::vector<body_union> values;
+    values.reserve(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        values.emplace_back(std::type_identity<T>{}, 1.0f, 2.0f, 3.0f, static_cast<double>(i));
+    }
+
+    std::string bytes;
+    bytes.reserve(count * poly_payload_size<particle>() + 1024);
+    double const write_ms = best_of_ms(5, [&]
+    {
+        bytes.clear();
+        serialize(string_sink{ bytes }, values);
+        do_not_optimize(bytes.data());
+    });
+
+    std::vector<body_union> read;
+    read.reserve(count);
+    double const read_ms = best_of_ms(5, [&]
+    {
+        read.clear();
+        deserialize(string_source{ bytes }, read);
+        do_not_optimize(read.data());
+    });
+
+    std::printf("%-18s %9zu values: serialize %7.2f ms, deserialize %7.2f ms\n", name, count, write_ms, read_ms);
+}
+
+int main()
+{
+    for (std::size_t count : { 100000, 1000000, 10000000 })
+    {
+        measure<particle>("packed", count);
+        measure<unpacked_particle>("member by member", count);
+    }
+}
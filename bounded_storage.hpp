@@ -5,6 +5,7 @@
 #include <type_traits>
 
 #include "basic_storage.hpp"
+#include "trivially_relocatable.hpp"
 
 template <typename T, int N>
 concept storage_size_at_most = sizeof(T) <= N;
@@ -13,7 +14,7 @@ template <int N, storage_size_at_most<N> Base>
 struct bounded_storage : basic_storage<N, Base>
 {
 
-    template <typename Derived, typename... Args>
+    template <storage_size_at_most<N> Derived, typename... Args>
     bounded_storage(std::type_identity<Derived> w, Args &&... args)
     {
         super::template unsafe_construct<Derived>(std::forward<Args>(args)...);
@@ -38,21 +39,48 @@ struct bounded_storage : basic_storage<N, Base>
     {
         super::unsafe_destroy_base();
         super::copy_construct_in_place_base(other.pointer());
+        return *this;
     }
 
     bounded_storage & operator=(bounded_storage && other) noexcept
     {
         super::unsafe_destroy_base();
         super::move_construct_in_place_base(other.pointer());
+        return *this;
+    }
+
+    // Swaps bytes for trivially relocatable hierarchies and moves through a
+    // temporary otherwise.
+    void swap(bounded_storage & other)
+    {
+        if constexpr (is_trivially_relocatable_hierarchy<Base>::value)
+        {
+            super::unsafe_swap_bytes(other);
+        }
+        else
+        {
+            bounded_storage tmp(std::move(other));
+            other = std::move(*this);
+            *this = std::move(tmp);
+        }
     }
 
     template <std::derived_from<Base> Derived, typename... Args>
+    requires storage_size_at_most<Derived, N>
     Derived * emplace(Args &&... args)
     {
         super::unsafe_destroy_base();
         return super::template unsafe_construct<Derived>(std::forward<Args>(args)...);
     }
 
+    // Replace the value by a bitwise copy of another object representation.
+    // Only valid for types that are trivially copyable except for their vptr.
+    void unsafe_assign_bytes(std::byte const * bytes)
+    {
+        super::unsafe_destroy_base();
+        super::unsafe_copy_bytes(bytes);
+    }
+
     Base * pointer()
     {
         return super::unsafe_base_pointer();
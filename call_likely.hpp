@@ -0,0 +1,282 @@
+#ifndef CALL_LIKELY_HPP
+#define CALL_LIKELY_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <compare>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <source_location>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#include "type_name.hpp"
+
+/**
+ * call_likely<Likely...>(u, f) calls f with the value of a poly union u.  If
+ * the value is exactly one of the types in Likely, f receives it as that
+ * type, otherwise as Base.  A generic lambda, e.g.,
+ *
+ *     call_likely<circle, square>(u, [](auto & s) { return s.area(); });
+ *
+ * then calls circle::area and square::area non-virtually, which permits
+ * inlining, if the classes or functions are final.  All other types use the
+ * virtual call.  The checks are in order, so the most likely type should come
+ * first.
+ *
+ * A type is recognized by comparing the vptr of the value with the one that
+ * was seen for that type before.  Until then typeid is compared instead.
+ * Values of a likely type that have a different vptr, e.g., because the vtable
+ * is duplicated in another shared library, take the virtual call.
+ *
+ * To choose the likely types, pass profile_call_sites as the last argument,
+ * e.g., call_likely<circle>(u, f, profile_call_sites).  Such calls record
+ * the dynamic type per call site, which may be exported with
+ * call_site_profile::write_csv or for_each.  Each thread counts on its own,
+ * the counts are merged when they are read.  Calls without the tag do not
+ * profile anything.
+ */
+struct call_site_profile
+{
+    struct type_count
+    {
+        std::string type;
+        std::uint64_t count;
+    };
+
+    // Calls f with the call site and its types, most frequent first.
+    static void for_each(std::function<void(std::string const &, std::vector<type_count> const &)> const & f)
+    {
+        site_map merged;
+        {
+            registry & r = get_registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            merged = r.finished;
+            for (thread_counts * t : r.threads)
+            {
+                t->merge_into(merged);
+            }
+        }
+
+        for (auto const & [site, counts] : merged)
+        {
+            std::string const name = std::string(site.file) + ':' + std::to_string(site.line) + ':' + site.function;
+            std::vector<type_count> sorted;
+            for (auto const & [type, count] : counts)
+            {
+                sorted.push_back({ type_name(*type), count });
+            }
+            std::sort(sorted.begin(), sorted.end(), [](type_count const & a, type_count const & b)
+            {
+                return a.count > b.count;
+            });
+            f(name, sorted);
+        }
+    }
+
+    // Sites and types are quoted, since their names may contain commas.
+    static void write_csv(std::ostream & os)
+    {
+        os << "site,type,count\n";
+        for_each([&os](std::string const & site, std::vector<type_count> const & counts)
+        {
+            for (type_count const & c : counts)
+            {
+                os << '"' << site << "\",\"" << c.type << "\"," << c.count << '\n';
+            }
+        });
+    }
+
+    // Only touches counters of the calling thread.  A lock is only taken
+    // the first time a thread sees a type at a call site.
+    static void record(std::source_location const & location, std::type_info const & type)
+    {
+        thread_local thread_counts counts;
+        counts.increment({ { location.file_name(), location.line(), location.function_name() }, &type });
+    }
+
+    private:
+
+    // The strings of a source_location are unique per call site.
+    struct site
+    {
+        char const * file;
+        std::uint_least32_t line;
+        char const * function;
+
+        auto operator<=>(site const &) const = default;
+    };
+
+    struct type_less
+    {
+        bool operator()(std::type_info const * a, std::type_info const * b) const
+        {
+            return a->before(*b);
+        }
+    };
+
+    typedef std::map<site, std::map<std::type_info const *, std::uint64_t, type_less>> site_map;
+
+    struct key
+    {
+        site s;
+        std::type_info const * type;
+
+        auto operator<=>(key const &) const = default;
+    };
+
+    struct thread_counts;
+
+    // Counters of running threads, and the merged counters of threads that
+    // finished.
+    struct registry
+    {
+        std::mutex mutex;
+        std::vector<thread_counts *> threads;
+        site_map finished;
+    };
+
+    static registry & get_registry()
+    {
+        static registry r;
+        return r;
+    }
+
+    // Only the owning thread writes the counters, so incrementing is a
+    // relaxed load and store.  Readers take the lock, which the owner only
+    // takes to insert, so the map does not change while it is read.
+    struct thread_counts
+    {
+        thread_counts()
+            : r(get_registry())
+        {
+            std::lock_guard<std::mutex> lock(r.mutex);
+            r.threads.push_back(this);
+        }
+
+        ~thread_counts()
+        {
+            std::lock_guard<std::mutex> lock(r.mutex);
+            merge_into(r.finished);
+            r.threads.erase(std::find(r.threads.begin(), r.threads.end(), this));
+        }
+
+        thread_counts(thread_counts const &) = delete;
+        thread_counts & operator=(thread_counts const &) = delete;
+
+        void increment(key const & k)
+        {
+            // Most call sites see the same type repeatedly.
+            if (last == nullptr || !(last_key == k))
+            {
+                auto it = counts.find(k);
+                if (it == counts.end())
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    it = counts.emplace(k, 0).first;
+                }
+                last_key = k;
+                last = &it->second;
+            }
+            last->store(last->load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        void merge_into(site_map & merged)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto const & [k, count] : counts)
+            {
+                merged[k.s][k.type] += count.load(std::memory_order_relaxed);
+            }
+        }
+
+        registry & r;
+        std::mutex mutex;
+        std::map<key, std::atomic<std::uint64_t>> counts;
+        key last_key {};
+        std::atomic<std::uint64_t> * last = nullptr;
+    };
+};
+
+namespace call_likely_detail
+{
+    // Vptr of the Base subobject of Derived, once seen.
+    template <typename Derived, typename Base>
+    struct known_vptr
+    {
+        static inline std::atomic<void const *> value { nullptr };
+    };
+
+    template <typename Derived, typename Base>
+    bool is_exactly(Base const * p)
+    {
+        void const * vptr = *reinterpret_cast<void const * const *>(p);
+        std::atomic<void const *> & known = known_vptr<Derived, Base>::value;
+        void const * k = known.load(std::memory_order_relaxed);
+        if (k != nullptr)
+        {
+            return vptr == k;
+        }
+        if (typeid(*p) != typeid(Derived))
+        {
+            return false;
+        }
+        known.store(vptr, std::memory_order_relaxed);
+        return true;
+    }
+
+    template <typename T, typename U>
+    using same_const_as = std::conditional_t<std::is_const_v<U>, T const, T>;
+
+    template <typename Result, typename Base, typename F>
+    Result call(Base * p, F & f)
+    {
+        return f(*p);
+    }
+
+    template <typename Result, typename Base, typename F, typename First, typename... Rest>
+    Result call(Base * p, F & f, std::type_identity<First>, std::type_identity<Rest>... rest)
+    {
+        static_assert(std::is_base_of_v<std::remove_const_t<Base>, First>, "Likely types have to derive from Base");
+
+        if (is_exactly<First, std::remove_const_t<Base>>(p))
+        {
+            return f(static_cast<same_const_as<First, Base> &>(*p));
+        }
+        return call<Result>(p, f, rest...);
+    }
+}
+
+// Tag to record the dynamic type of a call to call_likely per call site.
+struct profile_call_sites_tag
+{
+};
+
+inline constexpr profile_call_sites_tag profile_call_sites {};
+
+template <typename... Likely, typename Union, typename F>
+decltype(auto) call_likely(Union && u, F && f)
+{
+    auto * p = u.pointer();
+    typedef std::remove_pointer_t<decltype(p)> base_type;
+    static_assert(std::is_polymorphic_v<base_type>, "Base has to be polymorphic");
+    typedef decltype(f(*p)) result_type;
+
+    return call_likely_detail::call<result_type>(p, f, std::type_identity<Likely>{}...);
+}
+
+template <typename... Likely, typename Union, typename F>
+decltype(auto) call_likely(Union && u, F && f, profile_call_sites_tag, std::source_location const location = std::source_location::current())
+{
+    call_site_profile::record(location, typeid(*u.pointer()));
+    return call_likely<Likely...>(std::forward<Union>(u), std::forward<F>(f));
+}
+
+#endif
@@ -2,37 +2,43 @@
 #define CLOSED_POLY_UNION_HPP
 
 #include <concepts>
+#include <cstdint>
 
 #include "bounded_storage.hpp"
 #include "basic_poly_union.hpp"
 
-template <typename Type, typename... Types>
+// The folds below do not recurse, so the instantiation depth does not grow
+// with the number of types.
+template <typename... Types>
 constexpr int maximum_size_of()
 {
-    if constexpr (sizeof...(Types) == 0)
-    {
-        return sizeof(Type);
-    }
-    else
-    {
-        int constexpr remaining_size = maximum_size_of<Types...>();
-        return sizeof(Type) < remaining_size ? remaining_size : sizeof(Type);
-    }
+    int result = 0;
+    ((result = static_cast<int>(sizeof(Types)) < result ? result : static_cast<int>(sizeof(Types))), ...);
+    return result;
 }
 
-template <bool... B>
-struct bool_list
-{
-    static constexpr bool value_or = (B || ...);
-};
+template <typename T, typename... Ts>
+static constexpr bool is_member = (std::is_same_v<T, Ts> || ...);
 
+// Position of T in Ts, or sizeof...(Ts) if it is not a member.
 template <typename T, typename... Ts>
-static constexpr bool is_member = bool_list<std::is_same_v<T, Ts>...>::value_or;
+constexpr int index_of()
+{
+    int index = 0;
+    bool found = false;
+    ((found = found || std::is_same_v<T, Ts>, index += found ? 0 : 1), ...);
+    return index;
+}
 
 /**
  * closed_poly_union is a more restricted polymorphic union type.  Only the set
- * of specified types which are subclasses of Base are permitted.  The size of
- * the union is equal to the biggest storage size of all classes.
+ * of specified types which are subclasses of Base are permitted.
+ *
+ * The position of the current type in Derived is stored as well and may be
+ * queried with index().  It is used as a stable type tag, e.g., for
+ * serialization.  Hence the size of the union is the biggest storage size of
+ * all classes plus one or two bytes for the index, rounded up to the
+ * alignment, which usually adds alignof(Base) bytes.
  */
 template <typename Base, std::derived_from<Base>... Derived>
 struct closed_poly_union
@@ -47,10 +53,15 @@ struct closed_poly_union
         >
         wrapped_type;
 
+    typedef std::conditional_t<sizeof...(Derived) < 256, std::uint8_t, std::uint16_t> index_type;
+
+    static int constexpr type_count = sizeof...(Derived);
+
     template <typename T, typename... Args>
     requires is_member<T, Derived...>
     closed_poly_union(std::type_identity<T> w, Args &&... args)
         : wrapped_(w, std::forward<Args>(args)...)
+        , index_(index_of<T, Derived...>())
     {
     }
 
@@ -58,6 +69,7 @@ struct closed_poly_union
     requires is_member<T, Derived...>
     closed_poly_union(T const & v)
         : wrapped_(std::type_identity<T>{}, v)
+        , index_(index_of<T, Derived...>())
     {
     }
 
@@ -65,7 +77,9 @@ struct closed_poly_union
     requires is_member<T, Derived...>
     T & emplace(Args &&... args)
     {
-        return wrapped_.template emplace<T>(std::forward<Args>(args)...);
+        T & result = wrapped_.template emplace<T>(std::forward<Args>(args)...);
+        index_ = index_of<T, Derived...>();
+        return result;
     }
 
     // call emplace with copy constructor
@@ -106,9 +120,27 @@ struct closed_poly_union
         return *pointer();
     }
 
+    // position of the current type in Derived
+    int index() const
+    {
+        return index_;
+    }
+
+    void swap(closed_poly_union & other)
+    {
+        wrapped_.swap(other.wrapped_);
+        std::swap(index_, other.index_);
+    }
+
+    friend void swap(closed_poly_union & a, closed_poly_union & b)
+    {
+        a.swap(b);
+    }
+
     private:
 
     wrapped_type wrapped_;
+    index_type index_;
 };
 
 template <typename Union, typename T, typename... Args>
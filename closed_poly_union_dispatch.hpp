@@ -0,0 +1,138 @@
+#ifndef CLOSED_POLY_UNION_DISPATCH_HPP
+#define CLOSED_POLY_UNION_DISPATCH_HPP
+
+#include <array>
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "closed_poly_union.hpp"
+
+/**
+ * Double dispatch on two closed_poly_union values of the same type.
+ *
+ * dispatch(a, b, f) calls f with the concrete types of a and b, e.g.,
+ * f(circle &, rectangle &).  The call goes through a table of
+ * type_count * type_count function pointers that is generated at
+ * compile-time and indexed by the type tags of both values, i.e., it is a
+ * single indirect call without any virtual calls or branches.
+ *
+ * If a default handler d is given, it is called with references to Base for
+ * every pair that f does not accept.  dispatch_symmetric additionally calls
+ * f with swapped arguments if f only accepts the pair in the other order, so
+ * handlers for symmetric interactions have to be written and instantiated
+ * only once.  Its table still has an entry for every ordered pair.
+ *
+ * The result type R is the one of the default handler, or of f for the
+ * first type with itself if there is none.
+ */
+template <typename Union>
+struct closed_poly_union_dispatch_traits;
+
+template <typename Base, typename... Derived>
+struct closed_poly_union_dispatch_traits<closed_poly_union<Base, Derived...>>
+{
+    typedef Base base_type;
+    typedef std::tuple<Derived...> types;
+};
+
+template <typename Base, typename... Derived>
+struct closed_poly_union_dispatch_traits<closed_poly_union<Base, Derived...> const>
+{
+    typedef Base const base_type;
+    typedef std::tuple<Derived const...> types;
+};
+
+// Default handler that rejects unhandled pairs at compile-time.
+struct no_dispatch_default
+{
+};
+
+template <bool Symmetric, typename R, typename Union, typename F, typename D>
+struct pair_dispatcher
+{
+    typedef typename closed_poly_union_dispatch_traits<Union>::base_type base_type;
+    typedef typename closed_poly_union_dispatch_traits<Union>::types types;
+
+    static std::size_t constexpr TypeCount = std::tuple_size_v<types>;
+
+    typedef R (*entry_type)(F &, D &, base_type &, base_type &);
+
+    template <std::size_t I, std::size_t J>
+    static R call(F & f, D & d, base_type & a, base_type & b)
+    {
+        typedef std::tuple_element_t<I, types> A;
+        typedef std::tuple_element_t<J, types> B;
+
+        if constexpr (std::is_invocable_v<F &, A &, B &>)
+        {
+            return f(static_cast<A &>(a), static_cast<B &>(b));
+        }
+        else if constexpr (Symmetric && std::is_invocable_v<F &, B &, A &>)
+        {
+            return f(static_cast<B &>(b), static_cast<A &>(a));
+        }
+        else
+        {
+            static_assert(!std::is_same_v<D, no_dispatch_default>, "dispatch: a pair of types is not handled");
+            return d(a, b);
+        }
+    }
+
+    template <std::size_t... K>
+    static constexpr std::array<entry_type, sizeof...(K)> make_table(std::index_sequence<K...>)
+    {
+        return { &call<K / TypeCount, K % TypeCount>... };
+    }
+
+    static constexpr std::array<entry_type, TypeCount * TypeCount> table =
+        make_table(std::make_index_sequence<TypeCount * TypeCount>{});
+
+    static R dispatch(Union & a, Union & b, F & f, D & d)
+    {
+        return table[a.index() * TypeCount + b.index()](f, d, a.get(), b.get());
+    }
+};
+
+template <typename Union, typename F>
+using dispatch_result_without_default = std::invoke_result_t
+    < F &
+    , std::tuple_element_t<0, typename closed_poly_union_dispatch_traits<Union>::types> &
+    , std::tuple_element_t<0, typename closed_poly_union_dispatch_traits<Union>::types> &
+    >;
+
+template <typename Union, typename D>
+using dispatch_result_with_default = std::invoke_result_t
+    < D &
+    , typename closed_poly_union_dispatch_traits<Union>::base_type &
+    , typename closed_poly_union_dispatch_traits<Union>::base_type &
+    >;
+
+template <typename Union, typename F>
+dispatch_result_without_default<Union, F> dispatch(Union & a, Union & b, F && f)
+{
+    no_dispatch_default d;
+    return pair_dispatcher<false, dispatch_result_without_default<Union, F>, Union, std::remove_reference_t<F>, no_dispatch_default>::dispatch(a, b, f, d);
+}
+
+template <typename Union, typename F, typename D>
+dispatch_result_with_default<Union, D> dispatch(Union & a, Union & b, F && f, D && d)
+{
+    return pair_dispatcher<false, dispatch_result_with_default<Union, D>, Union, std::remove_reference_t<F>, std::remove_reference_t<D>>::dispatch(a, b, f, d);
+}
+
+template <typename Union, typename F>
+dispatch_result_without_default<Union, F> dispatch_symmetric(Union & a, Union & b, F && f)
+{
+    no_dispatch_default d;
+    return pair_dispatcher<true, dispatch_result_without_default<Union, F>, Union, std::remove_reference_t<F>, no_dispatch_default>::dispatch(a, b, f, d);
+}
+
+template <typename Union, typename F, typename D>
+dispatch_result_with_default<Union, D> dispatch_symmetric(Union & a, Union & b, F && f, D && d)
+{
+    return pair_dispatcher<true, dispatch_result_with_default<Union, D>, Union, std::remove_reference_t<F>, std::remove_reference_t<D>>::dispatch(a, b, f, d);
+}
+
+#endif
@@ -0,0 +1,508 @@
+#ifndef CLOSED_POLY_UNION_SERIALIZATION_HPP
+#define CLOSED_POLY_UNION_SERIALIZATION_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <memory>
+#include <new>
+#include <ostream>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if __has_include(<unistd.h>)
+#include <cerrno>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "closed_poly_union.hpp"
+#include "poly_fields.hpp"
+
+/**
+ * Binary serialization of sequences of closed_poly_union.
+ *
+ * The format starts with a header containing a magic number, the format
+ * version, and the payload size of every type in Derived, which detects
+ * layout changes between writer and reader.  It is followed by runs of
+ * elements with the same type, each consisting of the type tag (the position
+ * in Derived), the length of the run, and the payload of every element.
+ *
+ * Payloads are produced by poly_serializer, which may be specialized for
+ * each type.  The default writes the members returned by poly_fields (see
+ * poly_fields.hpp).  When reading, a default constructed value is assigned
+ * the stored members, so neither the vptr nor padding is ever written or
+ * read.  Objects cannot be copied as a whole for the same reason, but the
+ * default packs the members of a whole run straight into the chunk and
+ * unpacks them from it, with one bounds check per chunk instead of one per
+ * member.
+ *
+ * Data is written and read in chunks, so no second copy of the whole
+ * sequence is ever held in memory.  Errors are reported by throwing
+ * std::runtime_error.
+ */
+template <typename T>
+struct poly_serializer
+{
+    static_assert(has_poly_fields<T> && std::default_initializable<T>,
+                  "poly_serializer has to be specialized for types without poly_fields or a default constructor");
+
+    static std::size_t constexpr payload_size = poly_payload_size<T>();
+
+    template <typename Writer>
+    static void write(Writer & w, T const & v)
+    {
+        std::apply([&w](auto const &... fields) { (w.write(fields), ...); }, poly_fields(const_cast<T &>(v)));
+    }
+
+    // Read a value and pass the constructor arguments to construct.
+    template <typename Reader, typename Construct>
+    static void read(Reader & r, Construct && construct)
+    {
+        T value;
+        std::apply([&r](auto &... fields) { ((fields = r.template read<std::remove_cvref_t<decltype(fields)>>()), ...); }, poly_fields(value));
+        construct(std::move(value));
+    }
+
+    // Copy the members to and from payload_size bytes.
+    static void pack(std::byte * out, T const & v)
+    {
+        std::apply([&out](auto const &... fields) { ((std::memcpy(out, &fields, sizeof(fields)), out += sizeof(fields)), ...); }, poly_fields(const_cast<T &>(v)));
+    }
+
+    static void unpack(std::byte const * in, T & v)
+    {
+        std::apply([&in](auto &... fields) { ((std::memcpy(&fields, in, sizeof(fields)), in += sizeof(fields)), ...); }, poly_fields(v));
+    }
+};
+
+struct ostream_sink
+{
+    void write(std::byte const * data, std::size_t n)
+    {
+        if (!os.write(reinterpret_cast<char const *>(data), static_cast<std::streamsize>(n)))
+        {
+            throw std::runtime_error("poly_union serialization: failed to write to stream");
+        }
+    }
+
+    std::ostream & os;
+};
+
+struct istream_source
+{
+    // Returns 0 at the end of the stream.
+    std::size_t read_some(std::byte * data, std::size_t n)
+    {
+        return static_cast<std::size_t>(is.rdbuf()->sgetn(reinterpret_cast<char *>(data), static_cast<std::streamsize>(n)));
+    }
+
+    // Returns the number of bytes left, or 0 if the stream is not seekable.
+    std::size_t size_left()
+    {
+        std::streambuf * b = is.rdbuf();
+        std::streampos const position = b->pubseekoff(0, std::ios_base::cur, std::ios_base::in);
+        if (position == std::streampos(std::streamoff(-1)))
+        {
+            return 0;
+        }
+        std::streampos const end = b->pubseekoff(0, std::ios_base::end, std::ios_base::in);
+        b->pubseekpos(position, std::ios_base::in);
+        return end > position ? static_cast<std::size_t>(end - position) : 0;
+    }
+
+    std::istream & is;
+};
+
+#if __has_include(<unistd.h>)
+struct fd_sink
+{
+    void write(std::byte const * data, std::size_t n)
+    {
+        while (n > 0)
+        {
+            ssize_t const written = ::write(fd, data, n);
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (written <= 0)
+            {
+                throw std::runtime_error("poly_union serialization: failed to write to file descriptor");
+            }
+            data += written;
+            n -= static_cast<std::size_t>(written);
+        }
+    }
+
+    int fd;
+};
+
+struct fd_source
+{
+    // Returns 0 at the end of the file.
+    std::size_t read_some(std::byte * data, std::size_t n)
+    {
+        while (true)
+        {
+            ssize_t const count = ::read(fd, data, n);
+            if (count >= 0)
+            {
+                return static_cast<std::size_t>(count);
+            }
+            if (errno != EINTR)
+            {
+                throw std::runtime_error("poly_union serialization: failed to read from file descriptor");
+            }
+        }
+    }
+
+    // Returns the number of bytes left, or 0 if fd is not a regular file.
+    std::size_t size_left()
+    {
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+        {
+            return 0;
+        }
+        off_t const position = ::lseek(fd, 0, SEEK_CUR);
+        return position >= 0 && st.st_size > position ? static_cast<std::size_t>(st.st_size - position) : 0;
+    }
+
+    int fd;
+};
+#endif
+
+std::size_t constexpr poly_serialization_chunk_size = 1 << 16;
+
+// Serializers that pack whole runs, which requires a payload that fits into
+// a chunk.
+template <typename T>
+concept packed_poly_serializer = requires (std::byte * out, std::byte const * in, T & v)
+{
+    poly_serializer<T>::pack(out, v);
+    poly_serializer<T>::unpack(in, v);
+} && poly_serializer<T>::payload_size > 0 && poly_serializer<T>::payload_size <= poly_serialization_chunk_size;
+
+template <typename Sink>
+struct poly_writer
+{
+    poly_writer(Sink sink)
+        : sink_(sink)
+        , chunk_(std::make_unique<std::byte[]>(poly_serialization_chunk_size))
+    {
+    }
+
+    poly_writer(poly_writer const &) = delete;
+    poly_writer & operator=(poly_writer const &) = delete;
+
+    void write_bytes(std::byte const * data, std::size_t n)
+    {
+        if (used_ + n > poly_serialization_chunk_size)
+        {
+            flush();
+            if (n > poly_serialization_chunk_size)
+            {
+                sink_.write(data, n);
+                return;
+            }
+        }
+        std::memcpy(chunk_.get() + used_, data, n);
+        used_ += n;
+    }
+
+    template <typename T>
+    requires std::is_trivially_copyable_v<T>
+    void write(T const & v)
+    {
+        write_bytes(reinterpret_cast<std::byte const *>(&v), sizeof(T));
+    }
+
+    // Returns n bytes in the chunk, which have to be filled before the next
+    // write.  n may not exceed room().
+    std::byte * claim(std::size_t n)
+    {
+        std::byte * result = chunk_.get() + used_;
+        used_ += n;
+        return result;
+    }
+
+    // Bytes that may be claimed before the chunk is full.
+    std::size_t room() const
+    {
+        return poly_serialization_chunk_size - used_;
+    }
+
+    void flush()
+    {
+        if (used_ != 0)
+        {
+            sink_.write(chunk_.get(), used_);
+            used_ = 0;
+        }
+    }
+
+    private:
+
+    Sink sink_;
+    std::unique_ptr<std::byte[]> chunk_;
+    std::size_t used_ = 0;
+};
+
+template <typename Source>
+struct poly_reader
+{
+    poly_reader(Source source)
+        : source_(source)
+        , chunk_(std::make_unique<std::byte[]>(poly_serialization_chunk_size))
+    {
+    }
+
+    poly_reader(poly_reader const &) = delete;
+    poly_reader & operator=(poly_reader const &) = delete;
+
+    // Reads whole chunks, so data following the serialized sequence might be
+    // consumed as well.
+    void read_bytes(std::byte * data, std::size_t n)
+    {
+        while (n > 0)
+        {
+            if (position_ == available_)
+            {
+                refill();
+            }
+            std::size_t const count = std::min(n, available_ - position_);
+            std::memcpy(data, chunk_.get() + position_, count);
+            position_ += count;
+            data += count;
+            n -= count;
+        }
+    }
+
+    // Bytes that are buffered already.
+    std::size_t buffered() const
+    {
+        return available_ - position_;
+    }
+
+    // Returns n buffered bytes, n may not exceed buffered().
+    std::byte const * consume(std::size_t n)
+    {
+        std::byte const * result = chunk_.get() + position_;
+        position_ += n;
+        return result;
+    }
+
+    template <typename T>
+    requires std::is_trivially_copyable_v<T>
+    T read()
+    {
+        T result;
+        read_bytes(reinterpret_cast<std::byte *>(&result), sizeof(T));
+        return result;
+    }
+
+    // An upper bound of the bytes left in the input, which is only the
+    // buffered data if the source cannot tell.
+    std::size_t size_left()
+    {
+        std::size_t result = available_ - position_;
+        if constexpr (requires { source_.size_left(); })
+        {
+            result += source_.size_left();
+        }
+        return result;
+    }
+
+    private:
+
+    void refill()
+    {
+        available_ = source_.read_some(chunk_.get(), poly_serialization_chunk_size);
+        position_ = 0;
+        if (available_ == 0)
+        {
+            throw std::runtime_error("poly_union serialization: unexpected end of input");
+        }
+    }
+
+    Source source_;
+    std::unique_ptr<std::byte[]> chunk_;
+    std::size_t position_ = 0;
+    std::size_t available_ = 0;
+};
+
+std::uint32_t constexpr poly_serialization_magic = 0x50555331; // "PUS1"
+std::uint32_t constexpr poly_serialization_version = 2;
+
+template <typename Writer, typename Base, typename... Derived, std::size_t... I>
+void serialize_run(Writer & w, closed_poly_union<Base, Derived...> const * first, std::size_t count, int index, std::index_sequence<I...>)
+{
+    typedef void (*write_run_type)(Writer &, closed_poly_union<Base, Derived...> const *, std::size_t);
+    static constexpr write_run_type table[] =
+        { [](Writer & w, closed_poly_union<Base, Derived...> const * first, std::size_t count)
+          {
+              typedef std::tuple_element_t<I, std::tuple<Derived...>> T;
+              if constexpr (packed_poly_serializer<T>)
+              {
+                  std::size_t constexpr size = poly_serializer<T>::payload_size;
+                  while (count != 0)
+                  {
+                      if (w.room() < size)
+                      {
+                          w.flush();
+                      }
+                      std::size_t const n = std::min(count, w.room() / size);
+                      std::byte * out = w.claim(n * size);
+                      for (std::size_t i = 0; i < n; ++i)
+                      {
+                          poly_serializer<T>::pack(out + i * size, static_cast<T const &>(first[i].get()));
+                      }
+                      first += n;
+                      count -= n;
+                  }
+              }
+              else
+              {
+                  for (std::size_t i = 0; i < count; ++i)
+                  {
+                      poly_serializer<T>::write(w, static_cast<T const &>(first[i].get()));
+                  }
+              }
+          }...
+        };
+    table[index](w, first, count);
+}
+
+template <typename Reader, typename Base, typename... Derived, std::size_t... I>
+void deserialize_run(Reader & r, std::vector<closed_poly_union<Base, Derived...>> & out, std::size_t count, int index, std::index_sequence<I...>)
+{
+    typedef void (*read_run_type)(Reader &, std::vector<closed_poly_union<Base, Derived...>> &, std::size_t);
+    static constexpr read_run_type table[] =
+        { [](Reader & r, std::vector<closed_poly_union<Base, Derived...>> & out, std::size_t count)
+          {
+              typedef std::tuple_element_t<I, std::tuple<Derived...>> T;
+              if constexpr (packed_poly_serializer<T>)
+              {
+                  std::size_t constexpr size = poly_serializer<T>::payload_size;
+                  while (count != 0)
+                  {
+                      std::size_t const n = std::min(count, r.buffered() / size);
+                      if (n == 0)
+                      {
+                          // The payload straddles two chunks.
+                          std::byte payload[size];
+                          r.read_bytes(payload, size);
+                          T value;
+                          poly_serializer<T>::unpack(payload, value);
+                          out.emplace_back(std::type_identity<T>{}, std::move(value));
+                          --count;
+                          continue;
+                      }
+                      std::byte const * in = r.consume(n * size);
+                      for (std::size_t i = 0; i < n; ++i)
+                      {
+                          T value;
+                          poly_serializer<T>::unpack(in + i * size, value);
+                          out.emplace_back(std::type_identity<T>{}, std::move(value));
+                      }
+                      count -= n;
+                  }
+              }
+              else
+              {
+                  for (std::size_t i = 0; i < count; ++i)
+                  {
+                      poly_serializer<T>::read(r, [&out](auto &&... args)
+                      {
+                          out.emplace_back(std::type_identity<T>{}, std::forward<decltype(args)>(args)...);
+                      });
+                  }
+              }
+          }...
+        };
+    table[index](r, out, count);
+}
+
+template <typename Sink, typename Base, typename... Derived>
+void serialize(Sink sink, std::vector<closed_poly_union<Base, Derived...>> const & values)
+{
+    poly_writer<Sink> w(sink);
+
+    w.write(poly_serialization_magic);
+    w.write(poly_serialization_version);
+    w.write(static_cast<std::uint32_t>(sizeof...(Derived)));
+    (w.write(static_cast<std::uint32_t>(poly_serializer<Derived>::payload_size)), ...);
+    w.write(static_cast<std::uint64_t>(values.size()));
+
+    std::size_t begin = 0;
+    while (begin != values.size())
+    {
+        int const index = values[begin].index();
+        std::size_t end = begin + 1;
+        while (end != values.size() && values[end].index() == index)
+        {
+            ++end;
+        }
+
+        w.write(static_cast<std::uint32_t>(index));
+        w.write(static_cast<std::uint64_t>(end - begin));
+        serialize_run(w, values.data() + begin, end - begin, index, std::index_sequence_for<Derived...>{});
+        begin = end;
+    }
+
+    w.flush();
+}
+
+// Appends the deserialized values to out.
+template <typename Source, typename Base, typename... Derived>
+void deserialize(Source source, std::vector<closed_poly_union<Base, Derived...>> & out)
+{
+    poly_reader<Source> r(source);
+
+    if (r.template read<std::uint32_t>() != poly_serialization_magic)
+    {
+        throw std::runtime_error("poly_union serialization: invalid magic number");
+    }
+    if (r.template read<std::uint32_t>() != poly_serialization_version)
+    {
+        throw std::runtime_error("poly_union serialization: unsupported version");
+    }
+    if (r.template read<std::uint32_t>() != sizeof...(Derived))
+    {
+        throw std::runtime_error("poly_union serialization: number of types differs");
+    }
+    for (std::uint32_t size : { static_cast<std::uint32_t>(poly_serializer<Derived>::payload_size)... })
+    {
+        if (r.template read<std::uint32_t>() != size)
+        {
+            throw std::runtime_error("poly_union serialization: type layout differs");
+        }
+    }
+
+    std::uint64_t remaining = r.template read<std::uint64_t>();
+
+    // Do not trust the count of a corrupt or truncated input with the
+    // allocation, every element takes at least one byte of its run.
+    std::size_t constexpr minimum_size = std::max(std::size_t(1), std::min({ poly_serializer<Derived>::payload_size... }));
+    out.reserve(out.size() + std::min<std::uint64_t>(remaining, r.size_left() / minimum_size));
+    while (remaining != 0)
+    {
+        std::uint32_t const index = r.template read<std::uint32_t>();
+        std::uint64_t const count = r.template read<std::uint64_t>();
+        if (index >= sizeof...(Derived) || count > remaining)
+        {
+            throw std::runtime_error("poly_union serialization: corrupt run");
+        }
+
+        deserialize_run(r, out, count, index, std::index_sequence_for<Derived...>{});
+        remaining -= count;
+    }
+}
+
+#endif
@@ -0,0 +1,164 @@
+#ifndef CONCURRENT_POLY_UNION_HPP
+#define CONCURRENT_POLY_UNION_HPP
+
+#include <atomic>
+#include <concepts>
+#include <thread>
+#include <type_traits>
+
+#include "basic_storage.hpp"
+#include "bounded_storage.hpp"
+
+/**
+ * concurrent_poly_union is a polymorphic slot that may be replaced by a single
+ * writer while an arbitrary number of threads read through it.
+ *
+ * Two in-place buffers are used.  emplace constructs the new value in the
+ * buffer that is currently not visible to readers, publishes it, and then
+ * waits until all readers that might still observe the old value have left
+ * before destroying it.  Readers are tracked by two epoch counters (the
+ * left-right scheme): a reader registers with the current epoch, so the
+ * writer only has to flip the epoch and wait for the previous one to drain.
+ *
+ * Readers never block and never allocate, they only touch two counters and
+ * the active index.  The writer is the only party that waits.  Calling
+ * emplace from more than one thread at a time is not permitted.
+ *
+ * Access is only possible through read, which passes a reference to the
+ * current value to the given function.  The reference must not escape the
+ * function since the object might be destroyed afterwards.
+ */
+template <typename Base, int N>
+requires storage_size_at_most<Base, N>
+struct concurrent_poly_union
+{
+    template <std::derived_from<Base> Derived, typename... Args>
+    requires storage_size_at_most<Derived, N>
+    concurrent_poly_union(std::type_identity<Derived>, Args &&... args)
+    {
+        slots_[0].template construct<Derived>(std::forward<Args>(args)...);
+    }
+
+    ~concurrent_poly_union()
+    {
+        slots_[active_.load(std::memory_order_relaxed)].destroy();
+    }
+
+    concurrent_poly_union(concurrent_poly_union const &) = delete;
+    concurrent_poly_union & operator=(concurrent_poly_union const &) = delete;
+
+    template <typename F>
+    requires std::invocable<F, Base const &>
+    decltype(auto) read(F && f) const
+    {
+        reader_guard guard(*this);
+        return std::forward<F>(f)(static_cast<Base const &>(*slots_[guard.active()].pointer()));
+    }
+
+    // Only a single thread may call emplace at a time.
+    template <std::derived_from<Base> Derived, typename... Args>
+    requires storage_size_at_most<Derived, N>
+    void emplace(Args &&... args)
+    {
+        int const old_active = active_.load(std::memory_order_relaxed);
+        int const new_active = 1 - old_active;
+
+        // The inactive slot is empty: the previous emplace waited for its
+        // readers before destroying it.
+        slots_[new_active].template construct<Derived>(std::forward<Args>(args)...);
+        active_.store(new_active, std::memory_order_seq_cst);
+        // The counters are loaded with acquire ordering, which alone would
+        // not keep them from being read before the store is visible.  The
+        // fence orders the store before every load in wait_for_readers, so a
+        // reader that is not counted has to see the new index.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        wait_for_readers();
+        slots_[old_active].destroy();
+    }
+
+    private:
+
+    struct slot : basic_storage<N, Base>
+    {
+        template <typename Derived, typename... Args>
+        void construct(Args &&... args)
+        {
+            super::template unsafe_construct<Derived>(std::forward<Args>(args)...);
+        }
+
+        void destroy()
+        {
+            super::unsafe_destroy_base();
+        }
+
+        Base const * pointer() const
+        {
+            return super::unsafe_base_pointer();
+        }
+
+        private:
+
+        typedef basic_storage<N, Base> super;
+    };
+
+    // Keep the counters on their own cache lines since every reader writes
+    // to them.
+    struct alignas(64) reader_counter
+    {
+        std::atomic<long> value { 0 };
+    };
+
+    struct reader_guard
+    {
+        reader_guard(concurrent_poly_union const & u)
+            : counter_(u.readers_[u.epoch_.load(std::memory_order_acquire)].value)
+        {
+            counter_.fetch_add(1, std::memory_order_seq_cst);
+            active_ = u.active_.load(std::memory_order_seq_cst);
+        }
+
+        ~reader_guard()
+        {
+            counter_.fetch_sub(1, std::memory_order_release);
+        }
+
+        int active() const
+        {
+            return active_;
+        }
+
+        private:
+
+        std::atomic<long> & counter_;
+        int active_;
+    };
+
+    // Every reader that loaded the old active index registered itself in one
+    // of the counters before doing so.  The counter of the stale epoch only
+    // receives late readers and drains first, after flipping the epoch the
+    // same holds for the other one.
+    void wait_for_readers()
+    {
+        int const epoch = epoch_.load(std::memory_order_relaxed);
+        drain(readers_[1 - epoch].value);
+        epoch_.store(1 - epoch, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        drain(readers_[epoch].value);
+    }
+
+    static void drain(std::atomic<long> const & counter)
+    {
+        while (counter.load(std::memory_order_acquire) != 0)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    slot slots_[2];
+    std::atomic<int> active_ { 0 };
+    std::atomic<int> epoch_ { 0 };
+    mutable reader_counter readers_[2];
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef CONSTEXPR_POLY_UNION_HPP
+#define CONSTEXPR_POLY_UNION_HPP
+
+#include <concepts>
+
+#include "variant_storage.hpp"
+#include "basic_poly_union.hpp"
+
+/**
+ * constexpr_poly_union is a closed polymorphic union that may be constructed
+ * at compile-time, e.g., to build constexpr tables of polymorphic handlers
+ * that need no static initialization.  Since vptrs have to be relocated for
+ * position independent executables such tables end up in .data.rel.ro, which
+ * is read-only after loading, instead of .rodata:
+ *
+ *     constexpr std::array<constexpr_poly_union<handler, h1, h2>, 2> handlers =
+ *         { constexpr_poly_union<handler, h1, h2>(std::type_identity<h1>{})
+ *         , constexpr_poly_union<handler, h1, h2>(std::type_identity<h2>{}, 42)
+ *         };
+ *
+ * This requires constexpr constructors and a constexpr destructor for all
+ * types.  Some compilers (e.g., GCC 12) reject implicitly declared virtual
+ * destructors during constant evaluation, in that case declare them as
+ * constexpr ~T() override {}.  Virtual functions that are declared constexpr
+ * may also be called at compile-time.  index() returns the position of the
+ * current type in Derived, like closed_poly_union::index().
+ */
+template <typename Base, std::derived_from<Base>... Derived>
+using constexpr_poly_union = basic_poly_union
+    < Base
+    , maximum_size_of<Base, Derived...>()
+    , variant_storage<Base, Derived...>
+    , void
+    , (std::move_constructible<Derived> && ...)
+    , (std::copy_constructible<Derived> && ...)
+    >;
+
+#endif
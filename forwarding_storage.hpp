@@ -1,14 +1,34 @@
 #ifndef OPEN_STORAGE_HPP
 #define OPEN_STORAGE_HPP
 
+#include <cassert>
 #include <concepts>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <new>
 #include <type_traits>
+#include <utility>
 
 #include "basic_storage.hpp"
+#include "trivially_relocatable.hpp"
+
+/**
+ * forwarding_storage constructs values in its buffer if they fit and on the
+ * heap otherwise.
+ *
+ * Forwarded values may be relocated into memory that is not owned by the
+ * storage, e.g., a poly_arena, with relocate_forwarded.  They are destroyed
+ * but not freed by the storage and the memory has to outlive them.  A copy of
+ * such a value is allocated on the heap again.  The size of a forwarded value
+ * is recorded when it is constructed, so it does not depend on subclasses
+ * defining polymorphic_size.
+ */
+template <typename Base>
+int constexpr unique_base_ptr_size = sizeof(std::unique_ptr<Base>);
 
 template <int N, typename Base>
-struct forwarding_storage : basic_storage<N, Base>
+struct forwarding_storage : basic_storage<N < unique_base_ptr_size<Base> ? unique_base_ptr_size<Base> : N, Base>
 {
     template <std::derived_from<Base> Derived, typename... Args>
     forwarding_storage(std::type_identity<Derived> w, Args &&... args)
@@ -33,17 +53,12 @@ struct forwarding_storage : basic_storage<N, Base>
 
     forwarding_storage(forwarding_storage && other) noexcept
     {
-        if (other.is_forwarded_)
-        {
-            super::template unsafe_construct<unique_base_ptr>(std::move(other.unsafe_unique_ptr_reference()));
-        }
-        else
-        {
-            super::move_construct_in_place_base(other.pointer());
-        }
+        move_construct(other);
     }
 
     forwarding_storage(forwarding_storage const & other)
+        : is_forwarded_(other.is_forwarded_)
+        , forwarded_size_(other.forwarded_size_)
     {
         if (other.is_forwarded_)
         {
@@ -56,29 +71,48 @@ struct forwarding_storage : basic_storage<N, Base>
         }
     }
 
+    // Copies first, so this keeps its value if copying throws.
     forwarding_storage & operator=(forwarding_storage const & other)
     {
-        if (is_forwarded_ && other.is_forwarded_)
-        {
-            unsafe_unique_ptr_reference().reset(copy_construct_on_heap(other));
-        }
-        else
+        forwarding_storage copy(other);
+        return *this = std::move(copy);
+    }
+
+    forwarding_storage & operator=(forwarding_storage && other) noexcept
+    {
+        if (this != &other)
         {
             destroy();
-            super::copy_construct_in_place_base(other.pointer());
+            move_construct(other);
         }
+        return *this;
     }
 
-    forwarding_storage & operator=(forwarding_storage && other) noexcept
+    // Swaps pointers if both values are forwarded, bytes for trivially
+    // relocatable hierarchies, and moves through a temporary otherwise.
+    void swap(forwarding_storage & other)
     {
-        if (is_forwarded_ && other.is_forwarded_)
+        if constexpr (is_trivially_relocatable_hierarchy<Base>::value)
         {
-            unsafe_unique_ptr_reference().reset(move_construct_on_heap(other));
+            super::unsafe_swap_bytes(other);
+            std::swap(is_forwarded_, other.is_forwarded_);
+            std::swap(is_externally_owned_, other.is_externally_owned_);
+            std::swap(forwarded_size_, other.forwarded_size_);
         }
         else
         {
-            destroy();
-            super::move_construct_in_place_base(other.pointer());
+            if (is_forwarded_ && other.is_forwarded_)
+            {
+                std::swap(unsafe_unique_ptr_reference(), other.unsafe_unique_ptr_reference());
+                std::swap(is_externally_owned_, other.is_externally_owned_);
+                std::swap(forwarded_size_, other.forwarded_size_);
+            }
+            else
+            {
+                forwarding_storage tmp(std::move(other));
+                other = std::move(*this);
+                *this = std::move(tmp);
+            }
         }
     }
 
@@ -90,15 +124,17 @@ struct forwarding_storage : basic_storage<N, Base>
         {
             if constexpr (new_one_fits)
             {
+                destroy();
                 is_forwarded_ = false;
-                super::template unsafe_destroy<unique_base_ptr>();
                 return super::template unsafe_construct<Derived>(std::forward<Args>(args)...);
             }
             else
             {
+                release_externally_owned();
                 auto & uptr = unsafe_unique_ptr_reference();
                 uptr = std::make_unique<Derived>(std::forward<Args>(args)...);
-                return reinterpret_cast<Derived *>(uptr.get());
+                forwarded_size_ = sizeof(Derived);
+                return static_cast<Derived *>(uptr.get());
             }
         }
         else
@@ -116,6 +152,45 @@ struct forwarding_storage : basic_storage<N, Base>
         }
     }
 
+    bool is_forwarded() const
+    {
+        return is_forwarded_;
+    }
+
+    // Whether the value is forwarded to memory that is not owned by this.
+    bool is_externally_owned() const
+    {
+        return is_externally_owned_;
+    }
+
+    // Size of the concrete type of a forwarded value.
+    std::size_t forwarded_size() const
+    {
+        return forwarded_size_;
+    }
+
+    // Move a forwarded value to target, which has to be suitably aligned and
+    // at least forwarded_size() bytes large.  target has to outlive the value.
+    void relocate_forwarded(std::byte * target)
+    requires std::derived_from<Base, polymorphic_movable>
+    {
+        auto & uptr = unsafe_unique_ptr_reference();
+        polymorphic_movable * m = uptr.get();
+        // A subclass that does not define polymorphic_size inherits the
+        // size of its base, and would be sliced by
+        // polymorphic_move_construct_in_place as well.
+        assert(m->polymorphic_size() == 0 || m->polymorphic_size() == forwarded_size_);
+
+        // Base is not necessarily at the start of the concrete object.
+        std::byte const * const object = static_cast<std::byte const *>(dynamic_cast<void const *>(uptr.get()));
+        std::ptrdiff_t const base_offset = reinterpret_cast<std::byte const *>(uptr.get()) - object;
+
+        m->polymorphic_move_construct_in_place(target);
+        release_externally_owned();
+        uptr.reset(std::launder(reinterpret_cast<Base *>(target + base_offset)));
+        is_externally_owned_ = true;
+    }
+
     Base * pointer()
     {
         if (is_forwarded_)
@@ -144,10 +219,28 @@ struct forwarding_storage : basic_storage<N, Base>
 
     typedef std::unique_ptr<Base> unique_base_ptr;
 
+    // Assumption: this holds no value.
+    void move_construct(forwarding_storage & other) noexcept
+    {
+        is_forwarded_ = other.is_forwarded_;
+        is_externally_owned_ = other.is_externally_owned_;
+        forwarded_size_ = other.forwarded_size_;
+        if (other.is_forwarded_)
+        {
+            super::template unsafe_construct<unique_base_ptr>(std::move(other.unsafe_unique_ptr_reference()));
+            other.is_externally_owned_ = false;
+        }
+        else
+        {
+            super::move_construct_in_place_base(other.pointer());
+        }
+    }
+
     void destroy()
     {
         if (is_forwarded_)
         {
+            release_externally_owned();
             super::template unsafe_destroy<unique_base_ptr>();
         }
         else
@@ -156,18 +249,28 @@ struct forwarding_storage : basic_storage<N, Base>
         }
     }
 
-    Base * copy_construct_on_heap(forwarding_storage const & other)
+    // Destroy an externally owned value without freeing it.
+    void release_externally_owned()
     {
-        std::unique_ptr<std::byte[N]> heap_storage = std::make_unique<std::byte[N]>();
-        super::copy_construct_in_place_base(other.unsafe_unique_ptr_reference().get(), heap_storage.get());
-        return reinterpret_cast<Base *>(heap_storage.release());
+        if (is_externally_owned_)
+        {
+            unsafe_unique_ptr_reference().release()->~Base();
+            is_externally_owned_ = false;
+        }
     }
 
-    Base * move_construct_on_heap(forwarding_storage && other)
+    Base * copy_construct_on_heap(forwarding_storage const & other)
     {
-        std::unique_ptr<std::byte[N]> heap_storage = std::make_unique<std::byte[N]>();
-        super::move_construct_in_place_base(other.unsafe_unique_ptr_reference().get(), heap_storage.get());
-        return reinterpret_cast<Base *>(heap_storage.release());
+        if constexpr (std::is_base_of_v<polymorphic_copyable, Base>)
+        {
+            polymorphic_copyable const * c = other.unsafe_unique_ptr_reference().get();
+            return static_cast<Base *>(c->polymorphic_copy_construct_on_heap());
+        }
+        else
+        {
+            static_assert(std::is_base_of_v<polymorphic_copyable, Base>,
+                          "Copy-construction requires that Base implements polymorphic_copyable");
+        }
     }
 
     unique_base_ptr & unsafe_unique_ptr_reference()
@@ -175,19 +278,27 @@ struct forwarding_storage : basic_storage<N, Base>
         return *super::template unsafe_pointer<unique_base_ptr>();
     }
 
+    unique_base_ptr const & unsafe_unique_ptr_reference() const
+    {
+        return *super::template unsafe_pointer<unique_base_ptr>();
+    }
+
 
     static int constexpr MinimumN = N < sizeof(unique_base_ptr) ? sizeof(unique_base_ptr) : N;
 
-    typedef basic_storage<N, Base> super;
+    typedef basic_storage<MinimumN, Base> super;
 
     template <typename Derived, typename... Args>
     Derived * construct_forwarded(Args &&... args)
     {
         auto result = super::template unsafe_construct<unique_base_ptr>(std::make_unique<Derived>(std::forward<Args>(args)...));
-        return reinterpret_cast<Derived *>(result->get());
+        forwarded_size_ = sizeof(Derived);
+        return static_cast<Derived *>(result->get());
     }
 
     bool is_forwarded_;
+    bool is_externally_owned_ = false;
+    std::uint32_t forwarded_size_ = 0;
 };
 
 #endif
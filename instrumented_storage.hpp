@@ -0,0 +1,335 @@
+#ifndef INSTRUMENTED_STORAGE_HPP
+#define INSTRUMENTED_STORAGE_HPP
+
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "type_name.hpp"
+
+/**
+ * instrumented_storage wraps another storage type and records how often each
+ * operation happens per concrete type, together with a latency histogram.
+ * It is used as the StorageType of basic_poly_union, e.g.,
+ *
+ *     basic_poly_union<Base, N, instrumented_storage<forwarding_storage<N, Base>>>
+ *
+ * Recorded operations are construction, emplace, copy, move, destruction, and
+ * spills.  A spill is a construction or emplace whose value does not live
+ * inside the storage itself, i.e., one that was allocated on the heap.
+ * Latencies are measured in time stamp counter ticks (or nanoseconds if not
+ * available) and collected in power-of-two buckets.  The destruction of a
+ * value that is replaced by emplace is counted, but its latency is part of
+ * the one of the emplace.
+ *
+ * instrumented_storage_if<Inner, Enabled> is instrumented_storage<Inner> or
+ * Inner itself, so instrumentation may be switched off by a constant without
+ * any cost.  Both are different types, translation units that disagree on
+ * the constant do not share any definitions.  The statistics can be
+ * exported with poly_union_statistics::write_json, write_csv, or for_each,
+ * which report the type names of type_name.hpp.
+ */
+enum class poly_union_operation
+{
+    construct,
+    emplace,
+    copy,
+    move,
+    destroy,
+    spill
+};
+
+inline char const * to_string(poly_union_operation op)
+{
+    switch (op)
+    {
+        case poly_union_operation::construct: return "construct";
+        case poly_union_operation::emplace: return "emplace";
+        case poly_union_operation::copy: return "copy";
+        case poly_union_operation::move: return "move";
+        case poly_union_operation::destroy: return "destroy";
+        case poly_union_operation::spill: return "spill";
+    }
+    return "unknown";
+}
+
+struct poly_union_operation_statistics
+{
+    static int constexpr BucketCount = 64;
+
+    // bucket i contains latencies in [2^(i - 1), 2^i)
+    std::atomic<std::uint64_t> count { 0 };
+    std::atomic<std::uint64_t> buckets[BucketCount] = {};
+
+    void record(std::uint64_t ticks)
+    {
+        count.fetch_add(1, std::memory_order_relaxed);
+        buckets[std::bit_width(ticks) < BucketCount ? std::bit_width(ticks) : BucketCount - 1].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Count an operation whose latency is part of another one.
+    void record_untimed()
+    {
+        count.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+struct poly_union_type_statistics
+{
+    static int constexpr OperationCount = 6;
+
+    poly_union_type_statistics(std::string type_name)
+        : name(std::move(type_name))
+    {
+    }
+
+    poly_union_operation_statistics & operator[](poly_union_operation op)
+    {
+        return operations[static_cast<int>(op)];
+    }
+
+    poly_union_operation_statistics const & operator[](poly_union_operation op) const
+    {
+        return operations[static_cast<int>(op)];
+    }
+
+    std::string name;
+    poly_union_operation_statistics operations[OperationCount];
+    poly_union_type_statistics * next = nullptr;
+};
+
+struct poly_union_statistics
+{
+    // Statistics of Derived, registered on first use.
+    template <typename Derived>
+    static poly_union_type_statistics & of()
+    {
+        static poly_union_type_statistics & s = add(type_name(typeid(Derived)));
+        return s;
+    }
+
+    static void for_each(std::function<void(poly_union_type_statistics const &)> const & f)
+    {
+        for (poly_union_type_statistics const * s = head().load(std::memory_order_acquire); s != nullptr; s = s->next)
+        {
+            f(*s);
+        }
+    }
+
+    // One line per type, operation, and non-empty bucket.  Type names are
+    // quoted, since names of templates contain commas.
+    static void write_csv(std::ostream & os)
+    {
+        os << "type,operation,bucket,count\n";
+        for_each([&os](poly_union_type_statistics const & s)
+        {
+            for (int op = 0; op < poly_union_type_statistics::OperationCount; ++op)
+            {
+                for (int b = 0; b < poly_union_operation_statistics::BucketCount; ++b)
+                {
+                    std::uint64_t const n = s.operations[op].buckets[b].load(std::memory_order_relaxed);
+                    if (n != 0)
+                    {
+                        os << '"' << s.name << "\"," << to_string(static_cast<poly_union_operation>(op)) << ',' << b << ',' << n << '\n';
+                    }
+                }
+            }
+        });
+    }
+
+    static void write_json(std::ostream & os)
+    {
+        os << '[';
+        bool first_type = true;
+        for_each([&os, &first_type](poly_union_type_statistics const & s)
+        {
+            os << (first_type ? "" : ",") << "{\"type\":\"" << s.name << "\"";
+            first_type = false;
+            for (int op = 0; op < poly_union_type_statistics::OperationCount; ++op)
+            {
+                poly_union_operation_statistics const & o = s.operations[op];
+                os << ",\"" << to_string(static_cast<poly_union_operation>(op)) << "\":{\"count\":" << o.count.load(std::memory_order_relaxed) << ",\"buckets\":[";
+                for (int b = 0; b < poly_union_operation_statistics::BucketCount; ++b)
+                {
+                    os << (b == 0 ? "" : ",") << o.buckets[b].load(std::memory_order_relaxed);
+                }
+                os << "]}";
+            }
+            os << '}';
+        });
+        os << "]\n";
+    }
+
+    static std::uint64_t ticks()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    private:
+
+    static std::atomic<poly_union_type_statistics *> & head()
+    {
+        static std::atomic<poly_union_type_statistics *> h { nullptr };
+        return h;
+    }
+
+    static poly_union_type_statistics & add(std::string name)
+    {
+        // Never freed, since the statistics may be exported at exit.
+        poly_union_type_statistics * s = new poly_union_type_statistics(std::move(name));
+        s->next = head().load(std::memory_order_relaxed);
+        while (!head().compare_exchange_weak(s->next, s, std::memory_order_release, std::memory_order_relaxed))
+        {
+        }
+        return *s;
+    }
+};
+
+template <typename Inner>
+struct instrumented_storage
+{
+    template <typename Derived, typename... Args>
+    instrumented_storage(std::type_identity<Derived> w, Args &&... args)
+        : instrumented_storage(poly_union_statistics::ticks(), w, std::forward<Args>(args)...)
+    {
+    }
+
+    ~instrumented_storage()
+    {
+        std::uint64_t const start = poly_union_statistics::ticks();
+        inner_.~Inner();
+        record(poly_union_operation::destroy, start);
+    }
+
+    instrumented_storage(instrumented_storage && other) noexcept
+        : instrumented_storage(poly_union_statistics::ticks(), std::move(other))
+    {
+    }
+
+    instrumented_storage(instrumented_storage const & other)
+        : instrumented_storage(poly_union_statistics::ticks(), other)
+    {
+    }
+
+    instrumented_storage & operator=(instrumented_storage const & other)
+    {
+        std::uint64_t const start = poly_union_statistics::ticks();
+        inner_ = other.inner_;
+        statistics_ = other.statistics_;
+        record(poly_union_operation::copy, start);
+        return *this;
+    }
+
+    instrumented_storage & operator=(instrumented_storage && other) noexcept
+    {
+        std::uint64_t const start = poly_union_statistics::ticks();
+        inner_ = std::move(other.inner_);
+        statistics_ = other.statistics_;
+        record(poly_union_operation::move, start);
+        return *this;
+    }
+
+    // Recorded as a move of this value.
+    void swap(instrumented_storage & other)
+    {
+        std::uint64_t const start = poly_union_statistics::ticks();
+        inner_.swap(other.inner_);
+        std::swap(statistics_, other.statistics_);
+        record(poly_union_operation::move, start);
+    }
+
+    template <typename Derived, typename... Args>
+    Derived * emplace(Args &&... args)
+    {
+        std::uint64_t const start = poly_union_statistics::ticks();
+        Derived * result = inner_.template emplace<Derived>(std::forward<Args>(args)...);
+        (*statistics_)[poly_union_operation::destroy].record_untimed();
+        statistics_ = &poly_union_statistics::of<Derived>();
+        record_construction(poly_union_operation::emplace, start);
+        return result;
+    }
+
+    auto pointer()
+    {
+        return inner_.pointer();
+    }
+
+    auto pointer() const
+    {
+        return inner_.pointer();
+    }
+
+    private:
+
+    // The start time is taken before any member is initialized.
+    template <typename Derived, typename... Args>
+    instrumented_storage(std::uint64_t start, std::type_identity<Derived> w, Args &&... args)
+        : inner_(w, std::forward<Args>(args)...)
+        , statistics_(&poly_union_statistics::of<Derived>())
+    {
+        record_construction(poly_union_operation::construct, start);
+    }
+
+    instrumented_storage(std::uint64_t start, instrumented_storage && other)
+        : inner_(std::move(other.inner_))
+        , statistics_(other.statistics_)
+    {
+        record(poly_union_operation::move, start);
+    }
+
+    instrumented_storage(std::uint64_t start, instrumented_storage const & other)
+        : inner_(other.inner_)
+        , statistics_(other.statistics_)
+    {
+        record(poly_union_operation::copy, start);
+    }
+
+    void record(poly_union_operation op, std::uint64_t start)
+    {
+        (*statistics_)[op].record(poly_union_statistics::ticks() - start);
+    }
+
+    void record_construction(poly_union_operation op, std::uint64_t start)
+    {
+        std::uint64_t const ticks = poly_union_statistics::ticks() - start;
+        (*statistics_)[op].record(ticks);
+        if (is_spilled())
+        {
+            (*statistics_)[poly_union_operation::spill].record(ticks);
+        }
+    }
+
+    bool is_spilled() const
+    {
+        std::byte const * p = reinterpret_cast<std::byte const *>(inner_.pointer());
+        std::byte const * begin = reinterpret_cast<std::byte const *>(&inner_);
+        return std::less<>{}(p, begin) || !std::less<>{}(p, begin + sizeof(Inner));
+    }
+
+    union
+    {
+        Inner inner_;
+    };
+    poly_union_type_statistics * statistics_;
+};
+
+template <typename Inner, bool Enabled>
+using instrumented_storage_if = std::conditional_t<Enabled, instrumented_storage<Inner>, Inner>;
+
+#endif
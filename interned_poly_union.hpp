@@ -0,0 +1,22 @@
+#ifndef INTERNED_POLY_UNION_HPP
+#define INTERNED_POLY_UNION_HPP
+
+#include "interned_storage.hpp"
+#include "basic_poly_union.hpp"
+
+/**
+ * interned_poly_union is a polymorphic union of immutable values that are
+ * deduplicated: equal values share a single reference-counted copy and the
+ * union itself only holds a pointer.  Access is const only.  It is always
+ * copyable and movable, since no value is copied.
+ */
+template <typename Base>
+using interned_poly_union = basic_poly_union<Base const, sizeof(void *), interned_storage<Base>, void, true, true>;
+
+template <typename Base, typename Derived, typename... Args>
+interned_poly_union<Base> make_interned_poly_union(Args &&... args)
+{
+    return interned_poly_union<Base>(std::type_identity<Derived>{}, std::forward<Args>(args)...);
+}
+
+#endif
@@ -0,0 +1,295 @@
+#ifndef INTERNED_STORAGE_HPP
+#define INTERNED_STORAGE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+
+#include "polymorphic_hashable.hpp"
+
+/**
+ * intern_table keeps one canonical, reference-counted copy of every distinct
+ * value of Base.  Values are compared with polymorphic_hashable.  The table
+ * is split into shards with a mutex each, so threads that intern different
+ * values rarely contend.  Copying and releasing a reference that is not the
+ * last one does not lock.
+ */
+template <typename Base>
+requires std::derived_from<Base, polymorphic_hashable> && std::has_virtual_destructor_v<Base>
+struct intern_table
+{
+    static std::size_t constexpr ShardCount = 64;
+
+    struct entry
+    {
+        std::atomic<std::size_t> references;
+        std::size_t hash;
+        Base const * value;
+    };
+
+    static intern_table & instance()
+    {
+        static intern_table table;
+        return table;
+    }
+
+    // Returns the canonical entry of a value equal to Derived(args...).
+    template <std::derived_from<Base> Derived, typename... Args>
+    entry * intern(Args &&... args)
+    {
+        static_assert(alignof(Derived) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "Derived is over-aligned");
+
+        if constexpr (std::move_constructible<Derived>)
+        {
+            // Values that are present already are found without allocating,
+            // by hashing a temporary that is only moved to the heap if it is
+            // new.
+            Derived value(std::forward<Args>(args)...);
+            entry key { { 0 }, static_cast<polymorphic_hashable const &>(value).polymorphic_hash(), &value };
+            {
+                shard & s = shard_of(key.hash);
+                std::lock_guard<std::mutex> lock(s.mutex);
+                auto it = s.entries.find(&key);
+                if (it != s.entries.end())
+                {
+                    (*it)->references.fetch_add(1, std::memory_order_relaxed);
+                    return *it;
+                }
+            }
+            return insert<Derived>(key.hash, std::move(value));
+        }
+        else
+        {
+            return insert<Derived>(std::nullopt, std::forward<Args>(args)...);
+        }
+    }
+
+    static void acquire(entry * e)
+    {
+        e->references.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release(entry * e)
+    {
+        std::size_t r = e->references.load(std::memory_order_relaxed);
+        while (r > 1)
+        {
+            if (e->references.compare_exchange_weak(r, r - 1, std::memory_order_release, std::memory_order_relaxed))
+            {
+                return;
+            }
+        }
+
+        // The last reference may only be dropped while no other thread can
+        // find the entry.
+        {
+            shard & s = shard_of(e->hash);
+            std::lock_guard<std::mutex> lock(s.mutex);
+            if (e->references.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            {
+                return;
+            }
+            s.entries.erase(e);
+        }
+        destroy(e);
+    }
+
+    // Number of distinct values.
+    std::size_t size()
+    {
+        std::size_t result = 0;
+        for (shard & s : shards_)
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            result += s.entries.size();
+        }
+        return result;
+    }
+
+    // Number of distinct values in the fullest shard, e.g., to check how
+    // well the hash values of a type are spread.
+    std::size_t max_shard_size()
+    {
+        std::size_t result = 0;
+        for (shard & s : shards_)
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            result = std::max(result, s.entries.size());
+        }
+        return result;
+    }
+
+    private:
+
+    static int constexpr ShardBits = 6;
+    static_assert(ShardCount == std::size_t(1) << ShardBits);
+
+    static std::size_t constexpr HeaderSize = (sizeof(entry) + __STDCPP_DEFAULT_NEW_ALIGNMENT__ - 1) / __STDCPP_DEFAULT_NEW_ALIGNMENT__ * __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+    struct entry_hash
+    {
+        std::size_t operator()(entry const * e) const
+        {
+            return e->hash;
+        }
+    };
+
+    struct entry_equal
+    {
+        bool operator()(entry const * a, entry const * b) const
+        {
+            return a == b || (a->hash == b->hash && static_cast<polymorphic_hashable const *>(a->value)->polymorphic_equal(*b->value));
+        }
+    };
+
+    struct shard
+    {
+        std::mutex mutex;
+        std::unordered_set<entry *, entry_hash, entry_equal> entries;
+    };
+
+    // Constructs a Derived behind a new entry, and returns it or an equal
+    // entry that is present already.  The value is hashed unless the hash is
+    // known.
+    template <typename Derived, typename... Args>
+    entry * insert(std::optional<std::size_t> hash, Args &&... args)
+    {
+        void * memory = ::operator new(HeaderSize + sizeof(Derived));
+        Derived * value;
+        try
+        {
+            value = ::new (static_cast<std::byte *>(memory) + HeaderSize) Derived(std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            ::operator delete(memory);
+            throw;
+        }
+        std::size_t const h = hash ? *hash : static_cast<polymorphic_hashable const &>(*value).polymorphic_hash();
+        entry * candidate = ::new (memory) entry { { 1 }, h, value };
+
+        entry * result;
+        {
+            shard & s = shard_of(candidate->hash);
+            std::lock_guard<std::mutex> lock(s.mutex);
+            auto [it, inserted] = s.entries.insert(candidate);
+            result = *it;
+            if (!inserted)
+            {
+                result->references.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        if (result != candidate)
+        {
+            destroy(candidate);
+        }
+        return result;
+    }
+
+    shard & shard_of(std::size_t hash)
+    {
+        // Hash values of small integers are often the integers themselves,
+        // so they are mixed by a Fibonacci multiplication, whose top bits
+        // depend on all bits of the hash.  The low bits of the hash select
+        // the bucket within the shard.
+        return shards_[(static_cast<std::uint64_t>(hash) * 0x9e3779b97f4a7c15u) >> (64 - ShardBits)];
+    }
+
+    static void destroy(entry * e)
+    {
+        e->value->~Base();
+        e->~entry();
+        ::operator delete(e);
+    }
+
+    shard shards_[ShardCount];
+};
+
+/**
+ * interned_storage stores a handle to the canonical copy of its value in
+ * intern_table<Base>, so equal values share their memory.  This is useful for
+ * many equal values that are built independently.  The values are immutable,
+ * pointer() only provides const access.  Copying increments a reference
+ * count.  Constructing hashes the new value and looks it up, which costs a
+ * lock, and an allocation if the value is new.
+ *
+ * Base has to implement polymorphic_hashable, e.g., with
+ * DEFINE_POLYMORPHIC_HASH in every subclass.
+ */
+template <typename Base>
+struct interned_storage
+{
+    typedef intern_table<Base> table_type;
+
+    template <std::derived_from<Base> Derived, typename... Args>
+    interned_storage(std::type_identity<Derived>, Args &&... args)
+        : entry_(table_type::instance().template intern<Derived>(std::forward<Args>(args)...))
+    {
+    }
+
+    ~interned_storage()
+    {
+        release();
+    }
+
+    interned_storage(interned_storage && other) noexcept
+        : entry_(std::exchange(other.entry_, nullptr))
+    {
+    }
+
+    interned_storage(interned_storage const & other)
+        : entry_(other.entry_)
+    {
+        if (entry_ != nullptr)
+        {
+            table_type::acquire(entry_);
+        }
+    }
+
+    interned_storage & operator=(interned_storage other)
+    {
+        swap(other);
+        return *this;
+    }
+
+    void swap(interned_storage & other)
+    {
+        std::swap(entry_, other.entry_);
+    }
+
+    template <std::derived_from<Base> Derived, typename... Args>
+    Derived const * emplace(Args &&... args)
+    {
+        typename table_type::entry * e = table_type::instance().template intern<Derived>(std::forward<Args>(args)...);
+        release();
+        entry_ = e;
+        return static_cast<Derived const *>(e->value);
+    }
+
+    Base const * pointer() const
+    {
+        return entry_ == nullptr ? nullptr : entry_->value;
+    }
+
+    private:
+
+    void release()
+    {
+        if (entry_ != nullptr)
+        {
+            table_type::instance().release(entry_);
+        }
+    }
+
+    typename table_type::entry * entry_;
+};
+
+#endif
@@ -1,9 +1,42 @@
 #include <vector>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "poly_union.hpp"
 #include "closed_poly_union.hpp"
 #include "forwarding_poly_union.hpp"
+#include "concurrent_poly_union.hpp"
+#include "shared_forwarding_poly_union.hpp"
+#include "closed_poly_union_serialization.hpp"
+#include "mapped_poly_table.hpp"
+#include "poly_run_vector.hpp"
+#include "multi_poly_union.hpp"
+#include "constexpr_poly_union.hpp"
+#include "poly_union_algorithm.hpp"
+#include "poly_flat_map.hpp"
+#include "relative_forwarding_poly_union.hpp"
+#include "interned_poly_union.hpp"
+#include "seqlock_poly_union.hpp"
+#include "closed_poly_union_dispatch.hpp"
+#include "registered_poly_union.hpp"
+#include "poly_priority_queue.hpp"
+
+#include "call_likely.hpp"
+
+#include "instrumented_storage.hpp"
 
 struct base : polymorphic_movable, polymorphic_copyable
 {
@@ -14,6 +47,41 @@ struct base : polymorphic_movable, polymorphic_copyable
 
 #include <iostream>
 
+// Count global allocations to check that no operation allocates unless the
+// value is forwarded to the heap.  Threads may allocate as well.
+static std::atomic<std::size_t> allocation_count { 0 };
+
+void * operator new(std::size_t size)
+{
+    ++allocation_count;
+    if (void * p = std::malloc(size))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void * p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void * p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+// Counts of special member function calls of c_verbose.
+struct operation_counts
+{
+    int constructions = 0;
+    int copies = 0;
+    int moves = 0;
+    int destructions = 0;
+};
+
+static operation_counts c_verbose_counts;
+
 struct c1 : base
 {
     c1()
@@ -125,16 +193,19 @@ struct c_verbose : base
 {
     c_verbose()
     {
+        ++c_verbose_counts.constructions;
         std::cout << "c_verbose()" << std::endl;
     }
 
     c_verbose(c_verbose && other)
     {
+        ++c_verbose_counts.moves;
         std::cout << "c_verbose(&&)" << std::endl;
     }
 
     c_verbose(c_verbose const & other)
     {
+        ++c_verbose_counts.copies;
         std::cout << "c_verbose(const &)" << std::endl;
     }
 
@@ -145,6 +216,7 @@ struct c_verbose : base
 
     ~c_verbose() override
     {
+        ++c_verbose_counts.destructions;
         std::cout << "~c_verbose()" << std::endl;
     }
 
@@ -256,10 +328,10 @@ void demonstrate_poly_union()
         std::cout << "copy assignable = " << std::is_copy_assignable_v<poly_union<base, 24>> << std::endl;
         std::cout << "move constructible = " << std::is_move_constructible_v<poly_union<base, 24>> << std::endl;
         std::cout << "copy constructible = " << std::is_copy_constructible_v<poly_union<base, 24>> << std::endl;
-        std::cout << "storage move assignable = " << std::is_move_assignable_v<open_storage<24, base>> << std::endl;
-        std::cout << "storage copy assignable = " << std::is_copy_assignable_v<open_storage<24, base>> << std::endl;
-        std::cout << "storage move constructible = " << std::is_move_constructible_v<open_storage<24, base>> << std::endl;
-        std::cout << "storage copy constructible = " << std::is_copy_constructible_v<open_storage<24, base>> << std::endl;
+        std::cout << "storage move assignable = " << std::is_move_assignable_v<forwarding_storage<24, base>> << std::endl;
+        std::cout << "storage copy assignable = " << std::is_copy_assignable_v<forwarding_storage<24, base>> << std::endl;
+        std::cout << "storage move constructible = " << std::is_move_constructible_v<forwarding_storage<24, base>> << std::endl;
+        std::cout << "storage copy constructible = " << std::is_copy_constructible_v<forwarding_storage<24, base>> << std::endl;
         std::cout << std::is_nothrow_default_constructible_v<poly_union<base, 24>> << std::endl;
         typedef poly_union<base, 24> type;
 
@@ -353,9 +425,1675 @@ void demonstrate_forwarding_poly_union()
     }
 }
 
+void demonstrate_concurrent_poly_union()
+{
+    print_header("concurrent_poly_union");
+
+    // concurrent_poly_union double-buffers its storage.  Readers only see the
+    // value through read and never block, while a single writer may replace
+    // the value at any time.
+    {
+        concurrent_poly_union<base, 24> v(std::type_identity<c3>{}, 1, 2);
+        v.read([](base const & b){ b.const_greet(); });
+
+        v.emplace<c3>(3, 4);
+        v.read([](base const & b){ b.const_greet(); });
+    }
+}
+
+// Unlike assert, checks are not disabled by NDEBUG.
+void check(bool condition, char const * name, char const * what)
+{
+    if (!condition)
+    {
+        std::cerr << "check " << name << " failed: " << what << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+// Run f and check the number of allocations and c_verbose operations.
+template <typename F>
+void check_counts(char const * name, std::size_t allocations, operation_counts expected, F f)
+{
+    std::cout << "check " << name << std::endl;
+    c_verbose_counts = {};
+    std::size_t const start = allocation_count;
+    f();
+    check(allocation_count - start == allocations, name, "allocations");
+    check(c_verbose_counts.constructions == expected.constructions, name, "constructions");
+    check(c_verbose_counts.copies == expected.copies, name, "copies");
+    check(c_verbose_counts.moves == expected.moves, name, "moves");
+    check(c_verbose_counts.destructions == expected.destructions, name, "destructions");
+}
+
+void demonstrate_allocations()
+{
+    print_header("allocations");
+
+    // poly_union and closed_poly_union never allocate.
+    check_counts("poly_union construct", 0, { 1, 0, 0, 1 }, []
+    {
+        poly_union<base, 24> b(std::type_identity<c_verbose>{});
+    });
+    check_counts("poly_union emplace", 0, { 1, 0, 0, 1 }, []
+    {
+        poly_union<base, 24> b(std::type_identity<c1>{});
+        b.emplace<c_verbose>();
+    });
+    check_counts("poly_union copy", 0, { 1, 1, 0, 2 }, []
+    {
+        poly_union<base, 24> b(std::type_identity<c_verbose>{});
+        poly_union<base, 24> c = b;
+    });
+    check_counts("poly_union move", 0, { 1, 0, 1, 2 }, []
+    {
+        poly_union<base, 24> b(std::type_identity<c_verbose>{});
+        poly_union<base, 24> c = std::move(b);
+    });
+    check_counts("poly_union copy assignment", 0, { 2, 1, 0, 3 }, []
+    {
+        poly_union<base, 24> b(std::type_identity<c_verbose>{});
+        poly_union<base, 24> c(std::type_identity<c_verbose>{});
+        c = b;
+    });
+    check_counts("poly_union move assignment", 0, { 2, 0, 1, 3 }, []
+    {
+        poly_union<base, 24> b(std::type_identity<c_verbose>{});
+        poly_union<base, 24> c(std::type_identity<c_verbose>{});
+        c = std::move(b);
+    });
+    check_counts("closed_poly_union", 0, { 1, 1, 0, 2 }, []
+    {
+        typedef closed_poly_union<base, c1, c2, c3, c_verbose> closed_union_type;
+        closed_union_type v(std::type_identity<c3>{}, 1, 2);
+        v.emplace<c_verbose>();
+        closed_union_type w = v;
+    });
+
+    // forwarding_poly_union allocates exactly once for every value that does
+    // not fit.
+    check_counts("forwarding_poly_union in place", 0, { 1, 1, 1, 3 }, []
+    {
+        forwarding_poly_union<base, 16> v(std::type_identity<c_verbose>{});
+        forwarding_poly_union<base, 16> w = v;
+        forwarding_poly_union<base, 16> x = std::move(w);
+    });
+    check_counts("forwarding_poly_union spilled", 1, {}, []
+    {
+        forwarding_poly_union<base, 16> v(std::type_identity<c_big>{});
+    });
+    check_counts("forwarding_poly_union spilled copy", 2, {}, []
+    {
+        forwarding_poly_union<base, 16> v(std::type_identity<c_big>{});
+        forwarding_poly_union<base, 16> w = v;
+    });
+    check_counts("forwarding_poly_union spilled move", 1, {}, []
+    {
+        forwarding_poly_union<base, 16> v(std::type_identity<c_big>{});
+        forwarding_poly_union<base, 16> w = std::move(v);
+        w = std::move(w);
+    });
+    check_counts("forwarding_poly_union emplace", 2, { 1, 0, 0, 1 }, []
+    {
+        forwarding_poly_union<base, 16> v(std::type_identity<c_big>{});
+        v.emplace<c_verbose>();
+        v.emplace<c_big>();
+    });
+
+    // Swapping forwarded values only swaps pointers, other values are moved
+    // through a temporary.
+    check_counts("forwarding_poly_union swap", 2, { 1, 0, 2, 3 }, []
+    {
+        forwarding_poly_union<base, 16> v(std::type_identity<c_big>{});
+        forwarding_poly_union<base, 16> w(std::type_identity<c_big>{});
+        swap(v, w);
+
+        forwarding_poly_union<base, 16> x(std::type_identity<c_verbose>{});
+        swap(v, x);
+    });
+
+    // shared_forwarding_poly_union shares values on the heap between copies
+    // until the first non-const access, which allocates the copy together
+    // with its reference count.
+    check_counts("shared_forwarding_poly_union copy", 1, {}, []
+    {
+        shared_forwarding_poly_union<base, 16> v(std::type_identity<c_big>{});
+        shared_forwarding_poly_union<base, 16> w = v;
+        shared_forwarding_poly_union<base, 16> const & r = w;
+        r->const_greet();
+    });
+    check_counts("shared_forwarding_poly_union detach", 2, {}, []
+    {
+        shared_forwarding_poly_union<base, 16> v(std::type_identity<c_big>{});
+        shared_forwarding_poly_union<base, 16> w = v;
+        w->greet();
+        w->greet();
+    });
+
+    // A value that was accessed through a non-const pointer is copied by
+    // later copies, since the pointer may still modify it.
+    check_counts("shared_forwarding_poly_union modified", 2, {}, []
+    {
+        shared_forwarding_poly_union<base, 16> v(std::type_identity<c_big>{});
+        base * p = v.operator->();
+        shared_forwarding_poly_union<base, 16> w = v;
+        check(std::as_const(w).operator->() != p, "shared_forwarding_poly_union modified", "not shared");
+    });
+
+    // Move assignment releases the old value and moves the new one member by
+    // member.
+    check_counts("shared_forwarding_poly_union move assignment", 1, { 1, 0, 1, 2 }, []
+    {
+        shared_forwarding_poly_union<base, 16> v(std::type_identity<c_verbose>{});
+        shared_forwarding_poly_union<base, 16> w(std::type_identity<c_big>{});
+        w = std::move(v);
+        check(!w.storage().is_forwarded(), "shared_forwarding_poly_union move assignment", "in place");
+    });
+
+    // Growing a vector moves every element exactly once.
+    check_counts("vector growth", 2, { 2, 0, 1, 3 }, []
+    {
+        std::vector<poly_union<base, 16>> vs;
+        vs.reserve(1);
+        vs.emplace_back(std::type_identity<c_verbose>{});
+        vs.emplace_back(std::type_identity<c_verbose>{});
+    });
+}
+
+struct shape : polymorphic_movable, polymorphic_copyable
+{
+    virtual double area() const = 0;
+    virtual ~shape() {}
+};
+
+struct circle : shape
+{
+    circle() = default;
+    circle(double r) : radius(r) {}
+
+    double area() const override
+    {
+        return 3 * radius * radius;
+    }
+
+    friend auto poly_fields(circle & self)
+    {
+        return std::tie(self.radius);
+    }
+
+    DEFINE_POLYMORPHIC_MOVE()
+    DEFINE_POLYMORPHIC_COPY()
+
+    double radius = 0;
+};
+
+struct rectangle : shape
+{
+    rectangle() = default;
+    rectangle(float w, float h) : width(w), height(h) {}
+
+    double area() const override
+    {
+        return width * height;
+    }
+
+    friend auto poly_fields(rectangle & self)
+    {
+        return std::tie(self.width, self.height);
+    }
+
+    DEFINE_POLYMORPHIC_MOVE()
+    DEFINE_POLYMORPHIC_COPY()
+
+    float width = 0;
+    float height = 0;
+};
+
+DECLARE_TRIVIALLY_COPYABLE_EXCEPT_VPTR(circle)
+DECLARE_TRIVIALLY_COPYABLE_EXCEPT_VPTR(rectangle)
+
+void demonstrate_serialization()
+{
+    print_header("serialization");
+
+    // Only the members returned by poly_fields are written, never the vptr.
+    typedef closed_poly_union<shape, circle, rectangle> shape_union;
+    static_assert(sizeof(shape_union) == sizeof(circle) + alignof(shape));
+    std::vector<shape_union> shapes;
+    shapes.emplace_back(std::type_identity<circle>{}, 1.0);
+    shapes.emplace_back(std::type_identity<circle>{}, 2.0);
+    shapes.emplace_back(std::type_identity<rectangle>{}, 2.0f, 3.0f);
+
+    std::stringstream stream;
+    serialize(ostream_sink{ stream }, shapes);
+
+    std::vector<shape_union> read;
+    deserialize(istream_source{ stream }, read);
+    check(read.size() == shapes.size(), "deserialize", "size");
+    for (std::size_t i = 0; i < read.size(); ++i)
+    {
+        check(read[i].index() == shapes[i].index(), "deserialize", "type");
+        check(read[i]->area() == shapes[i]->area(), "deserialize", "value");
+    }
+    std::cout << "deserialized " << read.size() << " shapes" << std::endl;
+
+    // A corrupt element count is not trusted with the allocation.  The
+    // count follows the magic number, the version, and three sizes.
+    std::string corrupt = stream.str();
+    std::uint64_t const huge_count = std::uint64_t(1) << 40;
+    std::memcpy(corrupt.data() + 20, &huge_count, sizeof(huge_count));
+    std::istringstream corrupt_stream(corrupt);
+    std::vector<shape_union> corrupt_read;
+    bool rejected = false;
+    try
+    {
+        deserialize(istream_source{ corrupt_stream }, corrupt_read);
+    }
+    catch (std::runtime_error const &)
+    {
+        rejected = true;
+    }
+    check(rejected, "deserialize corrupt count", "rejected");
+
+    // Runs are packed into the chunks in bulk.  The first run puts the
+    // payloads of the second off the chunk boundary, so one of them
+    // straddles two chunks of the input.
+    std::vector<shape_union> many;
+    many.emplace_back(std::type_identity<rectangle>{}, 1.0f, 2.0f);
+    for (int i = 0; i < 20000; ++i)
+    {
+        many.emplace_back(std::type_identity<circle>{}, static_cast<double>(i));
+    }
+    std::stringstream many_stream;
+    serialize(ostream_sink{ many_stream }, many);
+    check(many_stream.str().size() == 28 + 12 + 8 + 12 + 20000 * 8, "serialize runs", "size");
+
+    std::vector<shape_union> many_read;
+    deserialize(istream_source{ many_stream }, many_read);
+    bool equal = many_read.size() == many.size();
+    for (std::size_t i = 0; equal && i < many.size(); ++i)
+    {
+        equal = many_read[i].index() == many[i].index() && many_read[i]->area() == many[i]->area();
+    }
+    check(equal, "deserialize runs", "values");
+}
+
+void demonstrate_mapped_poly_table()
+{
+    print_header("mapped_poly_table");
+
+    char path[] = "/tmp/mapped_poly_table_XXXXXX";
+    int const fd = ::mkstemp(path);
+    check(fd >= 0, "mapped_poly_table", "temporary file");
+    ::close(fd);
+
+    typedef mapped_poly_table<shape, circle, rectangle> table_type;
+    {
+        table_type table = table_type::create(path, 3);
+        table.emplace<circle>(0, 1.0);
+        table.emplace<rectangle>(1, 2.0f, 3.0f);
+        table.sync();
+    }
+
+    // A process that is still alive holds the lock of slot 1 until it is
+    // killed.
+    pid_t const holder = ::fork();
+    if (holder == 0)
+    {
+        ::pause();
+        ::_exit(0);
+    }
+    check(holder > 0, "mapped_poly_table", "fork");
+
+    // Pretend that the file was written by a process with a different image
+    // layout by changing every vptr in it, and that this process died while
+    // rebinding slot 0, which holds the lock 16 bytes before its value.
+    {
+        circle c;
+        rectangle r;
+        std::uintptr_t vptrs[4];
+        std::memcpy(vptrs, &c, 2 * sizeof(std::uintptr_t));
+        std::memcpy(vptrs + 2, &r, 2 * sizeof(std::uintptr_t));
+
+        std::FILE * file = std::fopen(path, "r+b");
+        std::vector<std::uintptr_t> words(4096);
+        words.resize(std::fread(words.data(), sizeof(std::uintptr_t), words.size(), file));
+        int changed = 0;
+        for (std::size_t i = 2; i < words.size(); ++i)
+        {
+            for (std::uintptr_t vptr : vptrs)
+            {
+                if (words[i] == vptr)
+                {
+                    words[i] ^= 0x1000;
+                    if (changed == 0)
+                    {
+                        words[i - 2] = (std::uint64_t(1) << 63) | 0x3ffffff0;
+                    }
+                    else if (changed == 2)
+                    {
+                        words[i - 2] = (std::uint64_t(1) << 63) | static_cast<std::uint64_t>(holder);
+                    }
+                    ++changed;
+                }
+            }
+        }
+        check(changed == 4, "mapped_poly_table", "vptrs in file");
+        std::rewind(file);
+        std::fwrite(words.data(), sizeof(std::uintptr_t), words.size(), file);
+        std::fclose(file);
+    }
+
+    {
+        table_type table = table_type::open(path);
+        check(table.size() == 3, "mapped_poly_table", "size");
+        check(table.index(0) == 0 && table.index(1) == 1 && !table.has_value(2), "mapped_poly_table", "tags");
+        check(table.get(0).area() == 3, "mapped_poly_table", "rebound circle");
+
+        std::atomic<bool> rebound { false };
+        std::thread reader([&table, &rebound]
+        {
+            table.get(1);
+            rebound = true;
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        check(!rebound, "mapped_poly_table", "lock of a live process kept");
+        ::kill(holder, SIGKILL);
+        ::waitpid(holder, nullptr, 0);
+        reader.join();
+        check(table.get(1).area() == 6, "mapped_poly_table", "rebound rectangle");
+
+        // The secondary vptr of polymorphic_copyable is rebound as well.
+        alignas(rectangle) std::byte buffer[sizeof(rectangle)];
+        static_cast<polymorphic_copyable const &>(table.get(1)).polymorphic_copy_construct_in_place(buffer);
+        shape * copy = std::launder(reinterpret_cast<rectangle *>(buffer));
+        check(copy->area() == 6, "mapped_poly_table", "copy of rebound value");
+        copy->~shape();
+        std::cout << "rebound " << table.size() - 1 << " values" << std::endl;
+    }
+
+    // A slot count whose size wraps around is not trusted.  The slot size
+    // follows the magic number, the version, and the type count, the slot
+    // count follows the slot size.
+    {
+        std::FILE * file = std::fopen(path, "r+b");
+        std::uint32_t slot_size;
+        std::fseek(file, 12, SEEK_SET);
+        check(std::fread(&slot_size, sizeof(slot_size), 1, file) == 1, "mapped_poly_table", "read slot size");
+        std::uint64_t const wrapping_count = ~std::uint64_t(0) / slot_size + 1;
+        std::fseek(file, 16, SEEK_SET);
+        std::fwrite(&wrapping_count, sizeof(wrapping_count), 1, file);
+        std::fclose(file);
+
+        bool rejected = false;
+        try
+        {
+            table_type::open(path);
+        }
+        catch (std::runtime_error const &)
+        {
+            rejected = true;
+        }
+        check(rejected, "mapped_poly_table", "wrapping slot count rejected");
+    }
+    std::remove(path);
+}
+
+// Throws once the given number of circles was constructed.
+struct limited_circle : circle
+{
+    limited_circle(double r) : circle(r)
+    {
+        if (constructions_left-- == 0)
+        {
+            throw std::runtime_error("limited_circle");
+        }
+    }
+
+    DEFINE_POLYMORPHIC_MOVE()
+    DEFINE_POLYMORPHIC_COPY()
+
+    static inline int constructions_left = 0;
+};
+
+void demonstrate_poly_run_vector()
+{
+    print_header("poly_run_vector");
+
+    // Batches grow the storage geometrically: 100 batches of 10 elements
+    // reallocate 8 times up to a capacity of 1280, plus one run.
+    poly_run_vector<shape, 24> shapes;
+    check_counts("poly_run_vector batches", 9, {}, [&shapes]
+    {
+        for (int i = 0; i < 100; ++i)
+        {
+            shapes.emplace_back_n<circle>(10, 1.0);
+        }
+    });
+    shapes.emplace_back<rectangle>(2.0f, 3.0f);
+    shapes.emplace_back_n<circle>(5, 2.0);
+
+    // A failed batch leaves no elements behind.
+    limited_circle::constructions_left = 3;
+    bool thrown = false;
+    try
+    {
+        shapes.emplace_back_n<limited_circle>(5, 10.0);
+    }
+    catch (std::runtime_error const &)
+    {
+        thrown = true;
+    }
+    check(thrown, "poly_run_vector", "exception");
+    shapes.emplace_back_n<circle>(2, 1.0);
+
+    check(shapes.size() == 1008, "poly_run_vector", "size");
+    check(shapes.run_count() == 3, "poly_run_vector", "runs");
+
+    double area = 0;
+    for (auto const & span : shapes.typed_spans<circle>())
+    {
+        for (circle const & c : span)
+        {
+            area += c.area();
+        }
+    }
+    check(area == 1000 * 3 + 5 * 12 + 2 * 3, "poly_run_vector", "typed spans");
+    check(shapes[1000].area() == 6, "poly_run_vector", "element");
+    std::cout << "area of " << shapes.size() << " shapes: " << area + shapes[1000].area() << std::endl;
+}
+
+struct drawable : polymorphic_movable, polymorphic_copyable
+{
+    virtual int draw() const = 0;
+    virtual ~drawable() {}
+};
+
+struct named
+{
+    virtual char const * name() const = 0;
+    virtual ~named() {}
+};
+
+static int labels_alive = 0;
+
+// named is the first base, so the primary interface is not at the start.
+struct label : named, drawable
+{
+    label(int s) : size(s)
+    {
+        ++labels_alive;
+    }
+
+    label(label const & other) : size(other.size)
+    {
+        ++labels_alive;
+    }
+
+    ~label() override
+    {
+        --labels_alive;
+    }
+
+    int draw() const override
+    {
+        return size;
+    }
+
+    char const * name() const override
+    {
+        return "label";
+    }
+
+    int size;
+
+    DEFINE_POLYMORPHIC_MOVE_FROM_COPY()
+    DEFINE_POLYMORPHIC_COPY()
+};
+
+struct failing_label : label
+{
+    failing_label() : label(0)
+    {
+        throw std::runtime_error("failing_label");
+    }
+};
+
+void demonstrate_multi_poly_union()
+{
+    print_header("multi_poly_union");
+
+    // poly_union<drawable, 32> rejects label at compile-time, since
+    // drawable is not at its start.
+    static_assert(!base_at_start<label, drawable> && base_at_start<label, named>);
+
+    typedef multi_poly_union<drawable, 32, named> widget;
+    {
+        widget w(std::type_identity<label>{}, 3);
+        check(w->draw() == 3 && std::strcmp(w.get<named>().name(), "label") == 0, "multi_poly_union", "interfaces");
+
+        widget copy = w;
+        widget moved = std::move(copy);
+        check(moved->draw() == 3, "multi_poly_union", "copy and move");
+
+        // A throwing constructor leaves the union empty instead of
+        // destroying the old value twice.
+        bool thrown = false;
+        try
+        {
+            w.emplace<failing_label>();
+        }
+        catch (std::runtime_error const &)
+        {
+            thrown = true;
+        }
+        check(thrown && w.pointer() == nullptr, "multi_poly_union", "empty after throw");
+
+        w = moved;
+        check(w.pointer() != nullptr && w->draw() == 3, "multi_poly_union", "assign to empty");
+        std::cout << w.get<named>().name() << " of size " << w->draw() << std::endl;
+    }
+    check(labels_alive == 0, "multi_poly_union", "destructions");
+}
+
+struct handler
+{
+    constexpr virtual int handle(int x) const = 0;
+    constexpr virtual ~handler() {}
+};
+
+struct doubler : handler
+{
+    constexpr int handle(int x) const override
+    {
+        return 2 * x;
+    }
+
+    constexpr ~doubler() override {}
+};
+
+struct adder : handler
+{
+    constexpr adder(int a) : amount(a) {}
+
+    constexpr int handle(int x) const override
+    {
+        return x + amount;
+    }
+
+    constexpr ~adder() override {}
+
+    int amount;
+};
+
+typedef constexpr_poly_union<handler, doubler, adder> handler_union;
+
+constexpr std::array<handler_union, 2> handlers =
+    { handler_union(std::type_identity<doubler>{})
+    , handler_union(std::type_identity<adder>{}, 42)
+    };
+
+static_assert(handlers[0]->handle(3) == 6);
+static_assert(handlers[1]->handle(3) == 45);
+static_assert(handlers[1].index() == 1 && handler_union::type_count == 2);
+
+void demonstrate_constexpr_poly_union()
+{
+    print_header("constexpr_poly_union");
+
+    // The same unions may be copied, moved, and grouped at run-time.
+    std::vector<handler_union> hs;
+    for (int i = 0; i < 6; ++i)
+    {
+        hs.push_back(handlers[i % 2]);
+    }
+    handler_union moved = std::move(hs.back());
+    hs.back().emplace<doubler>();
+    check(moved->handle(1) == 43 && hs.back()->handle(1) == 2, "constexpr_poly_union", "copy and move");
+
+    // partition_by_type uses index(), so the groups follow the order of
+    // the types.
+    std::vector<std::size_t> groups = partition_by_type(hs);
+    check(groups == std::vector<std::size_t>{ 0, 4, 6 }, "constexpr_poly_union", "partition_by_type");
+    check(hs[0].index() == 0 && hs[5].index() == 1, "constexpr_poly_union", "index");
+    std::cout << "handled " << hs[5]->handle(1) << std::endl;
+}
+
+// Larger than circle, so it must not inherit the size of circle.
+struct ring : circle
+{
+    ring(double r, double i) : circle(r), inner(i) {}
+
+    double area() const override
+    {
+        return circle::area() - 3 * inner * inner;
+    }
+
+    DEFINE_POLYMORPHIC_MOVE()
+    DEFINE_POLYMORPHIC_COPY()
+
+    double inner;
+};
+
+// shape is not at the start of a labelled_circle.
+struct circle_label
+{
+    virtual ~circle_label() = default;
+
+    long number = 7;
+};
+
+struct labelled_circle : circle_label, circle
+{
+    labelled_circle(double r) : circle(r) {}
+
+    DEFINE_POLYMORPHIC_MOVE()
+    DEFINE_POLYMORPHIC_COPY()
+};
+
+void demonstrate_poly_union_algorithm()
+{
+    print_header("poly_union_algorithm");
+
+    // All shapes are forwarded to the heap.  The arena has to outlive the
+    // values that are compacted into it.
+    poly_arena arena;
+    std::vector<forwarding_poly_union<shape, 8>> shapes;
+    for (int i = 0; i < 100; ++i)
+    {
+        if (i % 2 == 0)
+        {
+            shapes.emplace_back(std::type_identity<circle>{}, 1.0);
+        }
+        else
+        {
+            shapes.emplace_back(std::type_identity<ring>{}, 2.0, 1.0);
+        }
+    }
+
+    auto total_area = [](auto & range)
+    {
+        double result = 0;
+        for_each_prefetched(range, [&result](auto const & v) { result += v->area(); });
+        return result;
+    };
+    check(total_area(shapes) == 50 * 3 + 50 * 9, "poly_union_algorithm", "for_each_prefetched");
+
+    arena = compact_forwarded(shapes);
+    std::size_t const expected = 50 * poly_arena::aligned_size(sizeof(circle)) + 50 * poly_arena::aligned_size(sizeof(ring));
+    check(arena.size() == expected, "poly_union_algorithm", "compact_forwarded size");
+    check(shapes[1].storage().is_externally_owned() && shapes[1].storage().forwarded_size() == sizeof(ring),
+          "poly_union_algorithm", "compact_forwarded ownership");
+    check(total_area(shapes) == 50 * 3 + 50 * 9, "poly_union_algorithm", "compact_forwarded values");
+
+    // Copies of compacted values are allocated on the heap again.
+    forwarding_poly_union<shape, 8> copy = shapes[1];
+    check(!copy.storage().is_externally_owned() && copy->area() == 9, "poly_union_algorithm", "copy");
+
+    // Relocation keeps the offset of shape within the value.
+    std::vector<forwarding_poly_union<shape, 8>> labelled;
+    labelled.emplace_back(std::type_identity<labelled_circle>{}, 2.0);
+    poly_arena labelled_arena = compact_forwarded(labelled);
+    labelled_circle const * lc = dynamic_cast<labelled_circle const *>(labelled[0].pointer());
+    check(lc != nullptr && lc->area() == 12 && lc->number == 7, "poly_union_algorithm", "compact_forwarded with offset");
+    labelled.clear();
+
+    // Iterating does not detach shared values.
+    std::vector<shared_forwarding_poly_union<shape, 8>> shared(20, shared_forwarding_poly_union<shape, 8>(std::type_identity<ring>{}, 2.0, 1.0));
+    check(total_area(shared) == 20 * 9 && shared.back().storage().is_shared(), "poly_union_algorithm", "for_each_prefetched shared");
+
+    // Values that are stored in place have their vtables prefetched.
+    std::vector<forwarding_poly_union<shape, 32>> in_place;
+    for (int i = 0; i < 100; ++i)
+    {
+        in_place.emplace_back(std::type_identity<ring>{}, 2.0, 1.0);
+    }
+    check(!in_place[1].storage().is_forwarded() && total_area(in_place) == 100 * 9,
+          "poly_union_algorithm", "for_each_prefetched in place");
+    std::cout << "compacted " << arena.size() << " bytes" << std::endl;
+}
+
+void demonstrate_call_likely()
+{
+    print_header("call_likely");
+
+    std::vector<poly_union<shape, 32>> shapes;
+    for (int i = 0; i < 100; ++i)
+    {
+        if (i % 4 == 0)
+        {
+            shapes.emplace_back(std::type_identity<rectangle>{}, 2.0f, 3.0f);
+        }
+        else
+        {
+            shapes.emplace_back(std::type_identity<circle>{}, 1.0);
+        }
+    }
+    poly_union<shape, 32> copy = shapes[0];
+    shapes.push_back(std::move(copy));
+
+    // Likely types are called non-virtually.  This pays off the most when f
+    // makes several virtual calls on the value, which become a single check.
+    auto sum = [](auto const & s)
+    {
+        double result = 0;
+        for (int i = 1; i <= 4; ++i)
+        {
+            result += s.area() * i;
+        }
+        return result;
+    };
+
+    // Every thread counts its calls on its own, the counts are merged when
+    // they are read.
+    double totals[2] = {};
+    std::thread other([&]
+    {
+        for (auto const & s : shapes)
+        {
+            totals[1] += call_likely<circle>(s, sum, profile_call_sites);
+        }
+    });
+    for (auto const & s : shapes)
+    {
+        totals[0] += call_likely<circle>(s, sum, profile_call_sites);
+    }
+    other.join();
+
+    // Calls without the tag are not profiled.
+    check(call_likely<circle>(shapes[1], sum) == sum(shapes[1].get()), "call_likely", "without profiling");
+
+    double expected = 0;
+    for (auto const & s : shapes)
+    {
+        expected += sum(s.get());
+    }
+    check(totals[0] == expected && totals[1] == expected, "call_likely", "result");
+
+    std::uint64_t circles = 0;
+    std::uint64_t calls = 0;
+    bool demangled = false;
+    call_site_profile::for_each([&](std::string const & site, std::vector<call_site_profile::type_count> const & counts)
+    {
+        if (site.find("demonstrate_call_likely") != std::string::npos)
+        {
+            circles += counts.front().count;
+            demangled = counts.front().type == "circle";
+            for (call_site_profile::type_count const & c : counts)
+            {
+                calls += c.count;
+            }
+        }
+    });
+    check(circles == 2 * 75 && calls == 2 * 101, "call_likely", "profile");
+    check(demangled, "call_likely", "type names");
+    call_site_profile::write_csv(std::cout);
+}
+
+void demonstrate_poly_flat_map()
+{
+    print_header("poly_flat_map");
+
+    poly_flat_map<int, shape, 24> areas;
+    for (int i = 0; i < 1000; ++i)
+    {
+        if (i % 2 == 0)
+        {
+            areas.try_emplace<circle>(i, 1.0);
+        }
+        else
+        {
+            areas.try_emplace<rectangle>(i, 2.0f, 3.0f);
+        }
+    }
+    check(areas.size() == 1000 && areas.size() <= areas.capacity() / 4 * 3, "poly_flat_map", "load factor");
+    check(!areas.try_emplace<circle>(1, 5.0).second && areas.find(1)->area() == 6, "poly_flat_map", "try_emplace existing");
+
+    // Erasing shifts the following entries back, the others are still found.
+    for (int i = 0; i < 1000; i += 3)
+    {
+        areas.erase(i);
+    }
+    poly_flat_map<int, shape, 24> moved;
+    moved.try_emplace<circle>(-1, 1.0);
+    moved = std::move(areas);
+    bool found = true;
+    for (int i = 0; i < 1000; ++i)
+    {
+        shape const * s = moved.find(i);
+        found = found && (i % 3 == 0 ? s == nullptr : s != nullptr && s->area() == (i % 2 == 0 ? 3 : 6));
+    }
+    check(found && moved.size() == 666 && areas.empty(), "poly_flat_map", "erase and move");
+
+    double total = 0;
+    moved.for_each([&total](int, shape const & s) { total += s.area(); });
+    std::cout << "total area " << total << std::endl;
+}
+
+// Gives the values of demonstrate_relative_forwarding_poly_union their own
+// arena.
+struct churn_tag {};
+
+// Stateless commands fit into a single vptr, batches are forwarded.
+struct command : polymorphic_movable
+{
+    virtual ~command() = default;
+    virtual int run() const = 0;
+};
+
+struct nop_command : command
+{
+    int run() const override
+    {
+        return 0;
+    }
+
+    DEFINE_POLYMORPHIC_MOVE()
+};
+
+struct batch_command : command
+{
+    batch_command(int n) : steps{ n, n, n, n, n, n } {}
+
+    int run() const override
+    {
+        return steps[0] + steps[1] + steps[2] + steps[3] + steps[4] + steps[5];
+    }
+
+    DEFINE_POLYMORPHIC_MOVE()
+
+    int steps[6];
+};
+
+typedef relative_forwarding_poly_union<command, 8> command_union;
+static_assert(sizeof(command_union) == 8);
+
+// Constructed before the arena of the main thread and destroyed after it
+// was orphaned at exit, while it still holds a forwarded value.
+static command_union static_command(std::type_identity<nop_command>{});
+
+void demonstrate_relative_forwarding_poly_union()
+{
+    print_header("relative_forwarding_poly_union");
+
+    typedef relative_forwarding_poly_union<shape, 16, churn_tag> shape_union;
+    typedef offset_arena<shape, churn_tag> arena_type;
+
+    // Circles and rings do not fit, so every value is stored in the arena.
+    std::vector<shape_union> shapes;
+    for (int i = 0; i < 100; ++i)
+    {
+        shapes.emplace_back(std::type_identity<circle>{}, 1.0);
+    }
+    std::size_t const initial_capacity = arena_type::instance().capacity();
+
+    // Replacing values releases their blocks, which are reused by
+    // compacting instead of growing the arena.
+    for (int round = 0; round < 100; ++round)
+    {
+        for (shape_union & s : shapes)
+        {
+            if (round % 2 == 0)
+            {
+                s.emplace<ring>(2.0, 1.0);
+            }
+            else
+            {
+                s.emplace<circle>(1.0);
+            }
+        }
+    }
+    arena_type const & arena = arena_type::instance();
+    check(arena.capacity() <= 2 * initial_capacity && arena.size() <= 2 * arena.live_size() + arena.capacity() / 2,
+          "relative_forwarding_poly_union", "bounded under churn");
+
+    // Copy assignment copies before it destroys the old value.
+    shape_union copy(std::type_identity<ring>{}, 3.0, 1.0);
+    copy = shapes[0];
+    shapes[1] = copy;
+    shapes[2] = std::move(copy);
+    check(shapes[0]->area() == 3 && shapes[1]->area() == 3 && shapes[2]->area() == 3 && shapes[3]->area() == 3,
+          "relative_forwarding_poly_union", "copy");
+
+    double total = 0;
+    for (shape_union const & s : shapes)
+    {
+        total += s->area();
+    }
+    check(total == 300, "relative_forwarding_poly_union", "values");
+    std::cout << "arena of " << arena.capacity() << " bytes" << std::endl;
+
+    // Every thread forwards into its own arena of the default Tag.
+    std::vector<std::thread> threads;
+    std::atomic<int> results { 0 };
+    for (int t = 1; t <= 4; ++t)
+    {
+        threads.emplace_back([t, &results]
+        {
+            std::vector<command_union> commands;
+            for (int i = 0; i < 100; ++i)
+            {
+                commands.emplace_back(std::type_identity<nop_command>{});
+                commands.back().emplace<batch_command>(t);
+            }
+            command_union moved(std::move(commands[0]));
+            swap(moved, commands[1]);
+            commands[2].emplace<nop_command>();
+            int sum = moved->run();
+            for (command_union const & c : commands)
+            {
+                sum += c.pointer() == nullptr ? 0 : c->run();
+            }
+            results += sum;
+        });
+    }
+    for (std::thread & t : threads)
+    {
+        t.join();
+    }
+    check(results == (1 + 2 + 3 + 4) * 6 * 99, "relative_forwarding_poly_union", "threads");
+
+    static_command.emplace<batch_command>(1);
+    check(static_command->run() == 6, "relative_forwarding_poly_union", "static owner");
+}
+
+struct token : polymorphic_hashable
+{
+    virtual ~token() = default;
+    virtual int weight() const = 0;
+};
+
+struct number_token : token
+{
+    number_token(int v) : value(v) {}
+
+    int weight() const override
+    {
+        return value;
+    }
+
+    friend std::size_t hash_value(number_token const & t)
+    {
+        return std::hash<int>()(t.value);
+    }
+
+    bool operator==(number_token const & other) const
+    {
+        return value == other.value;
+    }
+
+    DEFINE_POLYMORPHIC_HASH()
+
+    int value;
+};
+
+struct symbol_token : token
+{
+    symbol_token(char s) : symbol(s) {}
+
+    int weight() const override
+    {
+        return 1;
+    }
+
+    friend std::size_t hash_value(symbol_token const & t)
+    {
+        return std::hash<char>()(t.symbol);
+    }
+
+    bool operator==(symbol_token const & other) const
+    {
+        return symbol == other.symbol;
+    }
+
+    DEFINE_POLYMORPHIC_HASH()
+
+    char symbol;
+};
+
+void demonstrate_interned_poly_union()
+{
+    print_header("interned_poly_union");
+
+    typedef interned_poly_union<token> token_union;
+    intern_table<token> & table = intern_table<token>::instance();
+
+    // Equal values share a single copy, values of different types are never
+    // equal.
+    std::vector<token_union> tokens;
+    for (int i = 0; i < 1000; ++i)
+    {
+        tokens.emplace_back(std::type_identity<number_token>{}, i % 10);
+    }
+    for (int i = 0; i < 100; ++i)
+    {
+        tokens.emplace_back(std::type_identity<symbol_token>{}, static_cast<char>('a' + i % 2));
+    }
+    check(table.size() == 12, "interned_poly_union", "size");
+    check(tokens[3].pointer() == tokens[13].pointer() && tokens[1000].pointer() == tokens[1002].pointer(),
+          "interned_poly_union", "shared values");
+
+    // Interning a value that is present already does not allocate.
+    check_counts("interned_poly_union duplicate", 0, {}, []
+    {
+        token_union t(std::type_identity<number_token>{}, 7);
+        token_union copy = t;
+        token_union moved = std::move(copy);
+        check(moved->weight() == 7, "interned_poly_union", "copy and move");
+    });
+    check(table.size() == 12, "interned_poly_union", "size after duplicates");
+
+    tokens.erase(tokens.begin() + 1000, tokens.end());
+    check(table.size() == 10, "interned_poly_union", "size after release");
+    tokens.clear();
+    check(table.size() == 0, "interned_poly_union", "empty");
+
+    // Values are spread over all shards, even though the hash values of
+    // number_token are small integers.
+    std::size_t const count = 100 * intern_table<token>::ShardCount;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        tokens.emplace_back(std::type_identity<number_token>{}, static_cast<int>(i));
+    }
+    check(table.size() == count, "interned_poly_union", "distinct values");
+    check(table.max_shard_size() <= 200, "interned_poly_union", "shard spread");
+    std::cout << "at most " << table.max_shard_size() << " of " << count << " values in one shard" << std::endl;
+    tokens.clear();
+}
+
+struct reading
+{
+    virtual ~reading() = default;
+    virtual long first() const = 0;
+    virtual long second() const = 0;
+};
+
+// Both readings always store equal values, so a torn read would be noticed.
+struct temperature : reading
+{
+    temperature(long v) : a(v), b(v) {}
+
+    long first() const override
+    {
+        return a;
+    }
+
+    long second() const override
+    {
+        return b;
+    }
+
+    long a;
+    long b;
+};
+
+struct pressure : reading
+{
+    pressure(long v) : a(v), b(v) {}
+
+    long first() const override
+    {
+        return b;
+    }
+
+    long second() const override
+    {
+        return a;
+    }
+
+    long a;
+    long b;
+};
+
+void demonstrate_concurrent_poly_union_readers()
+{
+    print_header("concurrent_poly_union readers");
+
+    // Readers run while a single writer replaces the value over and over.
+    concurrent_poly_union<reading, 24> v(std::type_identity<temperature>{}, 0);
+    std::atomic<bool> done { false };
+    std::atomic<long> reads { 0 };
+    std::atomic<long> torn { 0 };
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; ++i)
+    {
+        readers.emplace_back([&]
+        {
+            do
+            {
+                bool const consistent = v.read([](reading const & r) { return r.first() == r.second(); });
+                torn.fetch_add(consistent ? 0 : 1, std::memory_order_relaxed);
+                reads.fetch_add(1, std::memory_order_relaxed);
+            }
+            while (!done.load(std::memory_order_relaxed));
+        });
+    }
+
+    for (long i = 1; i <= 1000; ++i)
+    {
+        if (i % 2 == 0)
+        {
+            v.emplace<temperature>(i);
+        }
+        else
+        {
+            v.emplace<pressure>(i);
+        }
+    }
+    done = true;
+    for (std::thread & t : readers)
+    {
+        t.join();
+    }
+
+    check(torn == 0 && reads >= 4, "concurrent_poly_union readers", "consistent reads");
+    check(v.read([](reading const & r) { return r.first(); }) == 1000, "concurrent_poly_union readers", "last value");
+}
+
+DECLARE_TRIVIALLY_COPYABLE_EXCEPT_VPTR(temperature)
+DECLARE_TRIVIALLY_COPYABLE_EXCEPT_VPTR(pressure)
+
+void demonstrate_seqlock_poly_union()
+{
+    print_header("seqlock_poly_union");
+
+    // A read takes a copy, which is not affected by later writes.
+    {
+        seqlock_poly_union<shape, 32> v(std::type_identity<circle>{}, 1.0);
+        bounded_storage<32, shape> snapshot(std::type_identity<rectangle>{});
+        v.read(snapshot);
+        check(snapshot.pointer()->area() == 3, "seqlock_poly_union", "read");
+
+        bounded_storage<32, shape> copy(snapshot);
+        v.emplace<rectangle>(2.0f, 3.0f);
+        check(copy.pointer()->area() == 3, "seqlock_poly_union", "copy of a snapshot");
+        v.read(snapshot);
+        check(snapshot.pointer()->area() == 6, "seqlock_poly_union", "read after emplace");
+    }
+
+    // Readers retry instead of returning a value that is being written.
+    seqlock_poly_union<reading, 24> v(std::type_identity<temperature>{}, 0);
+    std::atomic<bool> done { false };
+    std::atomic<long> torn { 0 };
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; ++i)
+    {
+        readers.emplace_back([&]
+        {
+            bounded_storage<24, reading> snapshot(std::type_identity<temperature>{}, 0);
+            do
+            {
+                v.read(snapshot);
+                torn.fetch_add(snapshot.pointer()->first() == snapshot.pointer()->second() ? 0 : 1, std::memory_order_relaxed);
+            }
+            while (!done.load(std::memory_order_relaxed));
+        });
+    }
+
+    for (long i = 1; i <= 1000; ++i)
+    {
+        if (i % 2 == 0)
+        {
+            v.emplace<temperature>(i);
+        }
+        else
+        {
+            v.emplace<pressure>(i);
+        }
+    }
+    done = true;
+    for (std::thread & t : readers)
+    {
+        t.join();
+    }
+
+    bounded_storage<24, reading> last(std::type_identity<temperature>{}, 0);
+    v.read(last);
+    check(torn == 0, "seqlock_poly_union readers", "consistent reads");
+    check(last.pointer()->first() == 1000, "seqlock_poly_union readers", "last value");
+}
+
+void demonstrate_instrumented_storage()
+{
+    print_header("instrumented_storage");
+
+    typedef basic_poly_union<base, 32, instrumented_storage<forwarding_storage<32, base>>> instrumented_poly_union;
+    {
+        instrumented_poly_union v(std::type_identity<c3>{}, 1, 2);
+        instrumented_poly_union copy(v);
+        instrumented_poly_union moved(std::move(v));
+        copy.emplace<c_big>();
+        copy->greet();
+    }
+
+    poly_union_type_statistics const & c3_statistics = poly_union_statistics::of<c3>();
+    check(c3_statistics[poly_union_operation::construct].count == 1, "instrumented_storage", "construct");
+    check(c3_statistics[poly_union_operation::copy].count == 1, "instrumented_storage", "copy");
+    check(c3_statistics[poly_union_operation::move].count == 1, "instrumented_storage", "move");
+    check(c3_statistics[poly_union_operation::destroy].count == 3, "instrumented_storage", "destroy");
+    check(c3_statistics[poly_union_operation::spill].count == 0, "instrumented_storage", "no spill");
+
+    // c_big does not fit and is forwarded to the heap.
+    poly_union_type_statistics const & c_big_statistics = poly_union_statistics::of<c_big>();
+    check(c_big_statistics[poly_union_operation::emplace].count == 1, "instrumented_storage", "emplace");
+    check(c_big_statistics[poly_union_operation::spill].count == 1, "instrumented_storage", "spill");
+    check(c_big_statistics[poly_union_operation::destroy].count == 1, "instrumented_storage", "destroy spilled");
+
+    std::ostringstream json;
+    poly_union_statistics::write_json(json);
+    check(json.str().find("\"spill\":{\"count\":1") != std::string::npos, "instrumented_storage", "json");
+    std::ostringstream csv;
+    poly_union_statistics::write_csv(csv);
+    check(csv.str().find("\n\"c3\",copy,") != std::string::npos, "instrumented_storage", "csv");
+    std::cout << json.str();
+
+    static_assert(std::is_same_v<instrumented_storage_if<forwarding_storage<32, base>, false>, forwarding_storage<32, base>>);
+}
+
+// Only some pairs of shapes are handled, ring is handled as a circle.
+struct overlap
+{
+    int operator()(circle &, circle &) const
+    {
+        return 1;
+    }
+
+    int operator()(circle &, rectangle &) const
+    {
+        return 2;
+    }
+};
+
+void demonstrate_closed_poly_union_dispatch()
+{
+    print_header("closed_poly_union_dispatch");
+
+    typedef closed_poly_union<shape, circle, rectangle, ring> shape_union;
+    shape_union c(std::type_identity<circle>{}, 1.0);
+    shape_union r(std::type_identity<rectangle>{}, 2.0f, 3.0f);
+    shape_union copy(c);
+    shape_union moved(std::move(copy));
+    moved.emplace<ring>(2.0, 1.0);
+
+    auto unhandled = [](shape &, shape &) { return 0; };
+    check(dispatch(c, r, overlap{}, unhandled) == 2, "dispatch", "handled pair");
+    check(dispatch(r, c, overlap{}, unhandled) == 0, "dispatch", "default handler");
+    check(dispatch(moved, c, overlap{}, unhandled) == 1, "dispatch", "subclass");
+    check(dispatch_symmetric(r, c, overlap{}, unhandled) == 2, "dispatch_symmetric", "swapped pair");
+    check(dispatch_symmetric(r, moved, overlap{}, unhandled) == 2, "dispatch_symmetric", "swapped subclass");
+    check(dispatch_symmetric(r, r, overlap{}, unhandled) == 0, "dispatch_symmetric", "default handler");
+
+    // Without a default handler every pair has to be handled.
+    auto total_area = [](auto & a, auto & b) { return a.area() + b.area(); };
+    check(dispatch(c, moved, total_area) == 12, "dispatch", "all pairs");
+    shape_union const & const_moved = moved;
+    auto is_ring = [](auto & a, auto &) { return std::is_same_v<decltype(a), ring const &>; };
+    check(dispatch(const_moved, const_moved, is_ring), "dispatch", "const concrete type");
+}
+
+REGISTER_POLYMORPHIC_TYPE(shape, circle)
+REGISTER_POLYMORPHIC_TYPE(shape, rectangle)
+REGISTER_POLYMORPHIC_TYPE(shape, ring)
+
+void demonstrate_registered_poly_union()
+{
+    print_header("registered_poly_union");
+
+    // Ids are assigned in the order of registration during static
+    // initialization.
+    typedef type_registry<shape> registry;
+    check(registry::size() == 3, "type_registry", "size");
+    check(registry::id<circle>() == 0 && registry::id<rectangle>() == 1 && registry::id<ring>() == 2, "type_registry", "dense ids");
+    check(registry::type(2) == typeid(ring), "type_registry", "type");
+    std::cout << "registered " << registry::size() << " types in " << registry::registration_time().count() << " ns" << std::endl;
+
+    registered_poly_union<shape, 32> v(std::type_identity<circle>{}, 1.0);
+    registered_poly_union<shape, 32> copy(v);
+    registered_poly_union<shape, 32> moved(std::move(copy));
+    moved.emplace<ring>(2.0, 1.0);
+    check(v.index() == registry::id<circle>(), "registered_poly_union", "construct");
+    check(moved.index() == registry::id<ring>(), "registered_poly_union", "emplace");
+    swap(v, moved);
+    check(v.index() == registry::id<ring>() && v->area() == 9, "registered_poly_union", "swap");
+    check(moved.index() == registry::id<circle>() && moved->area() == 3, "registered_poly_union", "swap");
+
+    // The ids index per-type tables.
+    std::vector<registered_poly_union<shape, 32>> shapes;
+    shapes.emplace_back(std::type_identity<rectangle>{}, 2.0f, 3.0f);
+    shapes.push_back(v);
+    shapes.push_back(moved);
+    shapes.push_back(v);
+    std::vector<int> counts(registry::size());
+    for (registered_poly_union<shape, 32> const & s : shapes)
+    {
+        ++counts[s.index()];
+    }
+    check(counts == std::vector<int> { 1, 1, 2 }, "registered_poly_union", "per-type table");
+
+    // Registered ids are not bounded at compile-time, so the groups follow
+    // the first occurrence.
+    check(partition_by_type(shapes) == std::vector<std::size_t> { 0, 1, 3, 4 } && shapes[1].index() == registry::id<ring>(),
+          "registered_poly_union", "partition_by_type");
+}
+
+// A time stamp whose move constructor throws while moves_fail is set.
+struct fragile_time
+{
+    fragile_time(int t) : t(t) {}
+
+    fragile_time(fragile_time const &) = default;
+
+    fragile_time(fragile_time && other) : t(other.t)
+    {
+        if (moves_fail)
+        {
+            throw std::runtime_error("fragile_time");
+        }
+    }
+
+    bool operator<(fragile_time const & other) const
+    {
+        return t < other.t;
+    }
+
+    int t;
+
+    static inline bool moves_fail = false;
+};
+
+void demonstrate_poly_priority_queue()
+{
+    print_header("poly_priority_queue");
+
+    // Every time stamp is used by ten circles, which are scheduled in the
+    // order of their radius.
+    poly_priority_queue<int, shape, 32> events;
+    events.reserve(128);
+    check_counts("poly_priority_queue emplace", 0, {}, [&events]
+    {
+        for (int i = 0; i < 100; ++i)
+        {
+            events.emplace<circle>(i * 7 % 10, i);
+        }
+    });
+    events.emplace<rectangle>(-1, 2.0f, 3.0f);
+    check(events.top_time() == -1 && events.top().area() == 6, "poly_priority_queue", "top");
+
+    poly_priority_queue<int, shape, 32> moved(std::move(events));
+    check(events.empty() && moved.size() == 101, "poly_priority_queue", "move");
+    events.emplace<circle>(-2, 1.0);
+    events = std::move(moved);
+    std::swap(events, moved);
+    check(events.empty() && moved.size() == 101 && moved.top_time() == -1, "poly_priority_queue", "move assignment");
+    moved.pop();
+
+    // Events may schedule new events.
+    int runs = 0;
+    int last_time = -1;
+    double last_radius = -1;
+    while (!moved.empty())
+    {
+        moved.pop_and_run([&](int const & time, shape & s)
+        {
+            double const radius = static_cast<circle &>(s).radius;
+            check(time > last_time || (time == last_time && radius > last_radius), "poly_priority_queue", "order");
+            last_time = time;
+            last_radius = radius;
+            if (time < 1)
+            {
+                moved.emplace<circle>(10, 100 + runs);
+            }
+            ++runs;
+        });
+    }
+    check(runs == 110 && last_time == 10, "poly_priority_queue", "scheduled events");
+
+    // An event whose relocation throws stays at the top and is not run.
+    poly_priority_queue<fragile_time, shape, 32> fragile;
+    fragile.emplace<circle>(0, 1.0);
+    fragile_time::moves_fail = true;
+    bool thrown = false;
+    bool ran = false;
+    try
+    {
+        fragile.pop_and_run([&ran](fragile_time const &, shape &) { ran = true; });
+    }
+    catch (std::runtime_error const &)
+    {
+        thrown = true;
+    }
+    fragile_time::moves_fail = false;
+    check(thrown && !ran && fragile.size() == 1 && fragile.top().area() == 3, "poly_priority_queue", "throwing relocation");
+}
+
+// A trivially relocatable hierarchy.  The move constructors count the
+// relocations that were not done by copying bytes.
+static int mass_moves = 0;
+
+struct mass : polymorphic_movable, polymorphic_copyable
+{
+    virtual ~mass() = default;
+    virtual double total() const = 0;
+};
+
+DECLARE_TRIVIALLY_RELOCATABLE_HIERARCHY(mass)
+
+struct point_mass : mass
+{
+    point_mass(double m) : m(m) {}
+
+    point_mass(point_mass const &) = default;
+
+    point_mass(point_mass && other) : m(other.m)
+    {
+        ++mass_moves;
+    }
+
+    double total() const override
+    {
+        return m;
+    }
+
+    DEFINE_POLYMORPHIC_MOVE()
+    DEFINE_POLYMORPHIC_COPY()
+
+    double m;
+};
+
+struct mass_cluster : mass
+{
+    mass_cluster(double m) : masses { m, m, m, m } {}
+
+    mass_cluster(mass_cluster const &) = default;
+
+    mass_cluster(mass_cluster && other)
+    {
+        std::copy(std::begin(other.masses), std::end(other.masses), masses);
+        ++mass_moves;
+    }
+
+    double total() const override
+    {
+        return masses[0] + masses[1] + masses[2] + masses[3];
+    }
+
+    DEFINE_POLYMORPHIC_MOVE()
+    DEFINE_POLYMORPHIC_COPY()
+
+    double masses[4];
+};
+
+struct relocation_tag {};
+
+template <typename F>
+void check_relocated(char const * what, F f)
+{
+    mass_moves = 0;
+    bool const result = f();
+    check(result && mass_moves == 0, "trivially_relocatable", what);
+}
+
+void demonstrate_trivially_relocatable()
+{
+    print_header("trivially_relocatable");
+
+    check_relocated("bounded_storage swap", []
+    {
+        poly_union<mass, 48> a(std::type_identity<point_mass>{}, 1.0);
+        poly_union<mass, 48> b(std::type_identity<mass_cluster>{}, 2.0);
+        swap(a, b);
+        return a->total() == 8 && b->total() == 1;
+    });
+
+    // One value is stored in place and the other one is forwarded.
+    check_relocated("forwarding_storage swap", []
+    {
+        forwarding_poly_union<mass, 24> a(std::type_identity<point_mass>{}, 1.0);
+        forwarding_poly_union<mass, 24> b(std::type_identity<mass_cluster>{}, 2.0);
+        swap(a, b);
+        return a.storage().is_forwarded() && !b.storage().is_forwarded() && a->total() == 8 && b->total() == 1;
+    });
+
+    check_relocated("shared_forwarding_storage swap", []
+    {
+        shared_forwarding_poly_union<mass, 24> a(std::type_identity<point_mass>{}, 1.0);
+        shared_forwarding_poly_union<mass, 24> b(std::type_identity<mass_cluster>{}, 2.0);
+        swap(a, b);
+        return a.storage().is_forwarded() && !b.storage().is_forwarded() && a->total() == 8 && b->total() == 1;
+    });
+
+    // Inserting shifts entries and rehashes.
+    check_relocated("poly_flat_map", []
+    {
+        poly_flat_map<int, mass, 48> masses;
+        for (int i = 0; i < 1000; ++i)
+        {
+            masses.try_emplace<point_mass>(i, 1.0);
+        }
+        for (int i = 0; i < 1000; i += 2)
+        {
+            masses.erase(i);
+        }
+        double total = 0;
+        for (int i = 1; i < 1000; i += 2)
+        {
+            total += masses.find(i)->total();
+        }
+        return total == 500;
+    });
+
+    // Growing and popping relocate nodes.
+    check_relocated("poly_priority_queue", []
+    {
+        poly_priority_queue<int, mass, 48> queue;
+        for (int i = 0; i < 1000; ++i)
+        {
+            queue.emplace<mass_cluster>(i * 7 % 1000, 1.0);
+        }
+        int previous = -1;
+        bool ordered = true;
+        while (!queue.empty())
+        {
+            queue.pop_and_run([&previous, &ordered](int const & time, mass & m)
+            {
+                ordered = ordered && time == previous + 1 && m.total() == 4;
+                previous = time;
+            });
+        }
+        return ordered && previous == 999;
+    });
+
+    // Clusters are forwarded to the arena, point masses are stored in
+    // place.  Growing the vector moves the unions, adding values grows the
+    // arena, and compacting moves the remaining values.
+    check_relocated("relative_forwarding_storage and offset_arena", []
+    {
+        typedef relative_forwarding_poly_union<mass, 24, relocation_tag> mass_union;
+        typedef offset_arena<mass, relocation_tag> arena_type;
+
+        std::vector<mass_union> masses;
+        for (int i = 0; i < 1000; ++i)
+        {
+            if (i % 2 == 0)
+            {
+                masses.emplace_back(std::type_identity<mass_cluster>{}, 1.0);
+            }
+            else
+            {
+                masses.emplace_back(std::type_identity<point_mass>{}, 1.0);
+            }
+        }
+        bool const grown = arena_type::instance().capacity() > 4096;
+        for (int i = 0; i < 1000; i += 4)
+        {
+            masses[i].emplace<point_mass>(2.0);
+        }
+        arena_type::instance().compact();
+        swap(masses[0], masses[2]);
+        swap(masses[1], masses[3]);
+
+        double total = 0;
+        for (mass_union const & m : masses)
+        {
+            total += m->total();
+        }
+        return grown && masses[0].storage().is_forwarded() && !masses[2].storage().is_forwarded()
+            && arena_type::instance().live_size() == arena_type::instance().size() && total == 250 * 2 + 250 * 4 + 500;
+    });
+
+    // Open unions are grouped by typeid in the order of first occurrence.
+    check_relocated("partition_by_type", []
+    {
+        std::vector<poly_union<mass, 48>> masses;
+        for (int i = 0; i < 30; ++i)
+        {
+            if (i % 3 == 0)
+            {
+                masses.emplace_back(std::type_identity<mass_cluster>{}, 1.0);
+            }
+            else
+            {
+                masses.emplace_back(std::type_identity<point_mass>{}, 1.0);
+            }
+        }
+        mass_moves = 0;
+        std::vector<std::size_t> groups = partition_by_type(masses);
+        bool grouped = groups == std::vector<std::size_t>{ 0, 10, 30 };
+        for (std::size_t i = 0; i < masses.size(); ++i)
+        {
+            grouped = grouped && masses[i]->total() == (i < 10 ? 4 : 1);
+        }
+        return grouped;
+    });
+}
+
 int main(void)
 {
-    demonstrate_poly_union();
-    demonstrate_closed_poly_union();
-    demonstrate_forwarding_poly_union();
+    // Warm up std::cout, so its buffers are not counted.
+    std::cout << "" << std::flush;
+
+    // Values that do not fit forwarding_poly_union<base, 10> are allocated
+    // once, the vectors of demonstrate_poly_union allocate four times.
+    check_counts("demonstrate_poly_union", 4, { 5, 1, 1, 7 }, demonstrate_poly_union);
+    check_counts("demonstrate_closed_poly_union", 0, { 2, 1, 0, 3 }, demonstrate_closed_poly_union);
+    check_counts("demonstrate_forwarding_poly_union", 4, {}, demonstrate_forwarding_poly_union);
+    check_counts("demonstrate_concurrent_poly_union", 0, {}, demonstrate_concurrent_poly_union);
+    demonstrate_allocations();
+    demonstrate_serialization();
+    demonstrate_mapped_poly_table();
+    demonstrate_poly_run_vector();
+    demonstrate_multi_poly_union();
+    demonstrate_constexpr_poly_union();
+    demonstrate_poly_union_algorithm();
+    demonstrate_call_likely();
+    demonstrate_poly_flat_map();
+    demonstrate_relative_forwarding_poly_union();
+    demonstrate_interned_poly_union();
+    demonstrate_concurrent_poly_union_readers();
+    demonstrate_seqlock_poly_union();
+    demonstrate_instrumented_storage();
+    demonstrate_closed_poly_union_dispatch();
+    demonstrate_registered_poly_union();
+    demonstrate_poly_priority_queue();
+    demonstrate_trivially_relocatable();
 }
@@ -0,0 +1,385 @@
+#ifndef MAPPED_POLY_TABLE_HPP
+#define MAPPED_POLY_TABLE_HPP
+
+#include <atomic>
+#include <cerrno>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "closed_poly_union.hpp"
+#include "poly_fields.hpp"
+#include "trivially_copyable_except_vptr.hpp"
+
+/**
+ * mapped_poly_table is a fixed-size table of polymorphic values that lives in
+ * a memory-mapped file, so it may be shared between processes and survive
+ * restarts without deserialization.
+ *
+ * Each slot stores the position of its type in Derived as a tag and the
+ * value itself.  Because of address space layout randomization a vptr
+ * written by another process is generally invalid.  Every access therefore
+ * compares the primary vptr, which the Itanium C++ ABI places at the start of
+ * the object, with the vptr of the tag's type in this process.  If they
+ * differ the slot is rebound: a default constructed value is assigned the
+ * members returned by poly_fields (see poly_fields.hpp) and copied over the
+ * slot, which is valid for types that are trivially copyable except for
+ * their vptr.  The primary vptr is written last.
+ *
+ * Processes that share the image layout, e.g., workers forked from the same
+ * parent, never have to rebind and may use a shared mapping.  Processes with
+ * different layouts have to use a private mapping, since a rebound slot is
+ * only valid for the process that rebound it.  Rebinding is thread-safe.  A
+ * slot that is left locked by a process that died while rebinding it is
+ * unlocked by the next process that waits for it.  A lock is never taken
+ * from a process that is still alive, e.g., one that is stopped in a
+ * debugger, so waiters keep waiting for it.
+ *
+ * Errors are reported by throwing std::system_error or std::runtime_error.
+ */
+template <typename Base, std::derived_from<Base>... Derived>
+requires ((trivially_copyable_except_vptr<Derived> && has_poly_fields<Derived> && std::default_initializable<Derived>) && ...)
+struct mapped_poly_table
+{
+    enum class mapping
+    {
+        shared,
+        private_copy
+    };
+
+    // Create a new file with count empty slots, replacing existing files.
+    static mapped_poly_table create(char const * path, std::size_t count)
+    {
+        int const fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+        {
+            throw std::system_error(errno, std::generic_category(), path);
+        }
+
+        std::size_t const size = SlotsOffset + count * sizeof(slot);
+        if (::ftruncate(fd, static_cast<off_t>(size)) != 0)
+        {
+            int const error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), path);
+        }
+
+        mapped_poly_table result(fd, size, mapping::shared);
+
+        header & h = result.get_header();
+        h.magic = Magic;
+        h.version = Version;
+        h.type_count = sizeof...(Derived);
+        h.slot_size = sizeof(slot);
+        h.slot_count = count;
+        std::uint32_t const sizes[] = { static_cast<std::uint32_t>(sizeof(Derived))... };
+        std::memcpy(result.base_ + sizeof(header), sizes, sizeof(sizes));
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            result.slots_[i].tag = EmptyTag;
+        }
+
+        return result;
+    }
+
+    static mapped_poly_table open(char const * path, mapping m = mapping::private_copy)
+    {
+        int const fd = ::open(path, O_RDWR);
+        if (fd < 0)
+        {
+            throw std::system_error(errno, std::generic_category(), path);
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0)
+        {
+            int const error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), path);
+        }
+
+        std::size_t const size = static_cast<std::size_t>(st.st_size);
+        if (size < SlotsOffset)
+        {
+            ::close(fd);
+            throw std::runtime_error("mapped_poly_table: file too small");
+        }
+
+        mapped_poly_table result(fd, size, m);
+        result.validate();
+        return result;
+    }
+
+    mapped_poly_table(mapped_poly_table && other) noexcept
+        : base_(std::exchange(other.base_, nullptr))
+        , size_(other.size_)
+        , slots_(other.slots_)
+    {
+    }
+
+    mapped_poly_table & operator=(mapped_poly_table && other) noexcept
+    {
+        if (this != &other)
+        {
+            unmap();
+            base_ = std::exchange(other.base_, nullptr);
+            size_ = other.size_;
+            slots_ = other.slots_;
+        }
+        return *this;
+    }
+
+    ~mapped_poly_table()
+    {
+        unmap();
+    }
+
+    std::size_t size() const
+    {
+        return get_header().slot_count;
+    }
+
+    bool has_value(std::size_t i) const
+    {
+        return slots_[i].tag != EmptyTag;
+    }
+
+    // position of the type of slot i in Derived
+    int index(std::size_t i) const
+    {
+        return static_cast<int>(slots_[i].tag);
+    }
+
+    // Not thread-safe with respect to other accesses of the same slot.
+    template <typename T, typename... Args>
+    requires is_member<T, Derived...>
+    T & emplace(std::size_t i, Args &&... args)
+    {
+        slot & s = slots_[i];
+        T * result = ::new (s.storage) T(std::forward<Args>(args)...);
+        s.tag = index_of<T, Derived...>();
+        return *result;
+    }
+
+    // The slot must have a value.
+    Base & get(std::size_t i)
+    {
+        slot & s = slots_[i];
+        if (primary_vptr(s).load(std::memory_order_acquire) != expected_vptr(s.tag))
+        {
+            rebind(s);
+        }
+        return *std::launder(reinterpret_cast<Base *>(s.storage));
+    }
+
+    Base const & get(std::size_t i) const
+    {
+        return const_cast<mapped_poly_table &>(*this).get(i);
+    }
+
+    // Write changes of a shared mapping back to the file.
+    void sync()
+    {
+        if (::msync(base_, size_, MS_SYNC) != 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "msync");
+        }
+    }
+
+    private:
+
+    static std::uint32_t constexpr Magic = 0x50554d31; // "PUM1"
+    static std::uint32_t constexpr Version = 2;
+    static std::uint32_t constexpr EmptyTag = ~std::uint32_t(0);
+
+    // The lock of a slot is 0 or Locked combined with the pid of the process
+    // that is rebinding it.
+    static std::uint64_t constexpr Locked = std::uint64_t(1) << 63;
+
+    struct header
+    {
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint32_t type_count;
+        std::uint32_t slot_size;
+        std::uint64_t slot_count;
+    };
+
+    struct slot
+    {
+        std::uint64_t lock;
+        std::uint32_t tag;
+        alignas(Base) std::byte storage[maximum_size_of<Base, Derived...>()];
+    };
+
+    static std::size_t constexpr SlotsOffset =
+        (sizeof(header) + sizeof(std::uint32_t) * sizeof...(Derived) + alignof(slot) - 1) / alignof(slot) * alignof(slot);
+
+    mapped_poly_table(int fd, std::size_t size, mapping m)
+        : size_(size)
+    {
+        int const flags = m == mapping::shared ? MAP_SHARED : MAP_PRIVATE;
+        void * p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, fd, 0);
+        int const error = errno;
+        ::close(fd);
+        if (p == MAP_FAILED)
+        {
+            throw std::system_error(error, std::generic_category(), "mmap");
+        }
+        base_ = static_cast<std::byte *>(p);
+        slots_ = reinterpret_cast<slot *>(base_ + SlotsOffset);
+    }
+
+    void unmap()
+    {
+        if (base_ != nullptr)
+        {
+            ::munmap(base_, size_);
+        }
+    }
+
+    header & get_header()
+    {
+        return *reinterpret_cast<header *>(base_);
+    }
+
+    header const & get_header() const
+    {
+        return *reinterpret_cast<header const *>(base_);
+    }
+
+    void validate() const
+    {
+        header const & h = get_header();
+        std::uint32_t const sizes[] = { static_cast<std::uint32_t>(sizeof(Derived))... };
+        if (h.magic != Magic || h.version != Version)
+        {
+            throw std::runtime_error("mapped_poly_table: unsupported file");
+        }
+        if (h.type_count != sizeof...(Derived)
+            || h.slot_size != sizeof(slot)
+            || std::memcmp(base_ + sizeof(header), sizes, sizeof(sizes)) != 0)
+        {
+            throw std::runtime_error("mapped_poly_table: type layout differs");
+        }
+        // open checked that size_ >= SlotsOffset.  The product of an
+        // untrusted count and the slot size might overflow.
+        if (h.slot_count > (size_ - SlotsOffset) / sizeof(slot))
+        {
+            throw std::runtime_error("mapped_poly_table: file too small");
+        }
+    }
+
+    static std::atomic_ref<std::uint64_t> lock(slot & s)
+    {
+        return std::atomic_ref<std::uint64_t>(s.lock);
+    }
+
+    static std::atomic_ref<std::uintptr_t> primary_vptr(slot & s)
+    {
+        return std::atomic_ref<std::uintptr_t>(*reinterpret_cast<std::uintptr_t *>(s.storage));
+    }
+
+    // The primary vptr of a T in this process.
+    template <typename T>
+    static std::uintptr_t vptr_of()
+    {
+        static_assert(std::is_polymorphic_v<T> && sizeof(T) >= sizeof(std::uintptr_t));
+        alignas(T) std::byte bytes[sizeof(T)];
+        T * value = ::new (bytes) T;
+        std::uintptr_t result;
+        std::memcpy(&result, bytes, sizeof(result));
+        value->~T();
+        return result;
+    }
+
+    static std::uintptr_t expected_vptr(std::uint32_t tag)
+    {
+        static std::uintptr_t const vptrs[] = { vptr_of<Derived>()... };
+        return vptrs[tag];
+    }
+
+    void rebind(slot & s)
+    {
+        std::atomic_ref<std::uint64_t> l = lock(s);
+        std::uint64_t const own = Locked | static_cast<std::uint64_t>(::getpid());
+        while (primary_vptr(s).load(std::memory_order_acquire) != expected_vptr(s.tag))
+        {
+            std::uint64_t observed = 0;
+            if (l.compare_exchange_strong(observed, own, std::memory_order_acquire))
+            {
+                if (primary_vptr(s).load(std::memory_order_relaxed) != expected_vptr(s.tag))
+                {
+                    rebind_table(std::index_sequence_for<Derived...>{})[s.tag](s);
+                }
+
+                // Only release the lock if it is still held by this process.
+                std::uint64_t held = own;
+                l.compare_exchange_strong(held, 0, std::memory_order_release, std::memory_order_relaxed);
+                return;
+            }
+
+            if (is_holder_dead(observed))
+            {
+                l.compare_exchange_strong(observed, 0, std::memory_order_relaxed);
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    // Whether the process holding a lock died.  If its pid was reused in the
+    // meantime, the lock is kept until that process exits.
+    static bool is_holder_dead(std::uint64_t lock_value)
+    {
+        pid_t const pid = static_cast<pid_t>(lock_value & ~Locked);
+        return pid != ::getpid() && ::kill(pid, 0) != 0 && errno == ESRCH;
+    }
+
+    template <std::size_t... I>
+    static auto rebind_table(std::index_sequence<I...>)
+    {
+        typedef void (*rebind_type)(slot &);
+        static constexpr rebind_type table[] =
+            { [](slot & s)
+              {
+                  typedef std::tuple_element_t<I, std::tuple<Derived...>> T;
+
+                  // Only members are read from the stored value, never its
+                  // vptrs.
+                  T & stored = *std::launder(reinterpret_cast<T *>(s.storage));
+                  T fresh;
+                  poly_fields(fresh) = poly_field_values<T>(poly_fields(stored));
+
+                  // A bitwise copy within this process is valid.  Readers
+                  // only use the value once they see the new primary vptr.
+                  std::byte const * bytes = reinterpret_cast<std::byte const *>(&fresh);
+                  std::memcpy(s.storage + sizeof(std::uintptr_t), bytes + sizeof(std::uintptr_t), sizeof(T) - sizeof(std::uintptr_t));
+                  std::uintptr_t vptr;
+                  std::memcpy(&vptr, bytes, sizeof(vptr));
+                  primary_vptr(s).store(vptr, std::memory_order_release);
+              }...
+            };
+        return table;
+    }
+
+    std::byte * base_;
+    std::size_t size_;
+    slot * slots_;
+};
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef MULTI_INTERFACE_STORAGE_HPP
+#define MULTI_INTERFACE_STORAGE_HPP
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "closed_poly_union.hpp"
+#include "polymorphic_movable.hpp"
+#include "polymorphic_copyable.hpp"
+
+/**
+ * multi_interface_storage stores values with bounded storage size that
+ * implement several interfaces.  Every value has to derive from Primary and
+ * all of Interfaces.
+ *
+ * On construction and emplace the offset of every interface subobject within
+ * the value is recorded, so get<Interface>() is a pointer addition instead of
+ * a dynamic_cast.  In contrast to bounded_storage none of the interfaces has
+ * to be located at the start of the value.
+ *
+ * Primary is the base of the union: it is returned by pointer() and its
+ * virtual destructor destroys the value.  Move and copy construction are
+ * available if it implements polymorphic_movable or polymorphic_copyable.
+ *
+ * If the constructor of a value throws in emplace or copy assignment, the
+ * storage is left empty and pointer() returns nullptr.  An empty storage may
+ * only be destroyed, assigned, or given a new value with emplace.
+ */
+template <int N, typename Primary, typename... Interfaces>
+requires std::has_virtual_destructor_v<Primary> && (N <= 0xffff)
+struct multi_interface_storage
+{
+    template <typename Derived, typename... Args>
+    requires (std::derived_from<Derived, Primary> && ... && std::derived_from<Derived, Interfaces>) && (sizeof(Derived) <= N)
+    multi_interface_storage(std::type_identity<Derived>, Args &&... args)
+    {
+        construct<Derived>(std::forward<Args>(args)...);
+    }
+
+    ~multi_interface_storage()
+    {
+        destroy();
+    }
+
+    multi_interface_storage(multi_interface_storage && other)
+    requires std::derived_from<Primary, polymorphic_movable>
+    {
+        move_from(other);
+    }
+
+    multi_interface_storage(multi_interface_storage const & other)
+    requires std::derived_from<Primary, polymorphic_copyable>
+    {
+        copy_from(other);
+    }
+
+    multi_interface_storage & operator=(multi_interface_storage && other)
+    requires std::derived_from<Primary, polymorphic_movable>
+    {
+        if (this != &other)
+        {
+            destroy();
+            move_from(other);
+        }
+        return *this;
+    }
+
+    multi_interface_storage & operator=(multi_interface_storage const & other)
+    requires std::derived_from<Primary, polymorphic_copyable>
+    {
+        if (this != &other)
+        {
+            destroy();
+            copy_from(other);
+        }
+        return *this;
+    }
+
+    // Moves through a temporary.
+    void swap(multi_interface_storage & other)
+    requires std::derived_from<Primary, polymorphic_movable>
+    {
+        multi_interface_storage tmp(std::move(other));
+        other = std::move(*this);
+        *this = std::move(tmp);
+    }
+
+    template <typename Derived, typename... Args>
+    requires (std::derived_from<Derived, Primary> && ... && std::derived_from<Derived, Interfaces>) && (sizeof(Derived) <= N)
+    Derived * emplace(Args &&... args)
+    {
+        destroy();
+        return construct<Derived>(std::forward<Args>(args)...);
+    }
+
+    template <typename Interface>
+    requires is_member<Interface, Primary, Interfaces...>
+    Interface * get()
+    {
+        return std::launder(reinterpret_cast<Interface *>(buffer_ + offsets_.values[index_of<Interface, Primary, Interfaces...>()]));
+    }
+
+    template <typename Interface>
+    requires is_member<Interface, Primary, Interfaces...>
+    Interface const * get() const
+    {
+        return std::launder(reinterpret_cast<Interface const *>(buffer_ + offsets_.values[index_of<Interface, Primary, Interfaces...>()]));
+    }
+
+    Primary * pointer()
+    {
+        return empty() ? nullptr : get<Primary>();
+    }
+
+    Primary const * pointer() const
+    {
+        return empty() ? nullptr : get<Primary>();
+    }
+
+    private:
+
+    struct offset_array
+    {
+        std::uint16_t values[1 + sizeof...(Interfaces)];
+    };
+
+    // The offset of the primary interface of an empty storage.  Offsets of
+    // values are smaller than N.
+    static std::uint16_t constexpr Empty = 0xffff;
+
+    bool empty() const
+    {
+        return offsets_.values[0] == Empty;
+    }
+
+    // offsets_ is only set once the value was constructed, hence the storage
+    // is empty if a constructor throws.
+    template <typename Derived, typename... Args>
+    Derived * construct(Args &&... args)
+    {
+        Derived * result = ::new (buffer_) Derived(std::forward<Args>(args)...);
+        std::byte const * start = reinterpret_cast<std::byte const *>(result);
+        offsets_ = { { offset_of<Primary>(result, start), offset_of<Interfaces>(result, start)... } };
+        return result;
+    }
+
+    void move_from(multi_interface_storage & other)
+    {
+        if (!other.empty())
+        {
+            polymorphic_movable * m = other.template get<Primary>();
+            m->polymorphic_move_construct_in_place(buffer_);
+        }
+        offsets_ = other.offsets_;
+    }
+
+    void copy_from(multi_interface_storage const & other)
+    {
+        if (!other.empty())
+        {
+            polymorphic_copyable const * c = other.template get<Primary>();
+            c->polymorphic_copy_construct_in_place(buffer_);
+        }
+        offsets_ = other.offsets_;
+    }
+
+    template <typename Interface, typename Derived>
+    static std::uint16_t offset_of(Derived * value, std::byte const * start)
+    {
+        return static_cast<std::uint16_t>(reinterpret_cast<std::byte const *>(static_cast<Interface *>(value)) - start);
+    }
+
+    void destroy()
+    {
+        if (!empty())
+        {
+            get<Primary>()->~Primary();
+            offsets_.values[0] = Empty;
+        }
+    }
+
+    alignas(Primary) alignas(Interfaces...) std::byte buffer_[N];
+    offset_array offsets_ { { Empty } };
+};
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef MULTI_POLY_UNION_HPP
+#define MULTI_POLY_UNION_HPP
+
+#include "multi_interface_storage.hpp"
+#include "basic_poly_union.hpp"
+
+/**
+ * multi_poly_union is a polymorphic union with bounded storage size whose
+ * values implement Base and several other interfaces.  Every interface is
+ * reachable with get<Interface>() without a dynamic_cast, and none of them
+ * has to be located at the start of the value.  See
+ * multi_interface_storage for details.
+ */
+template <typename Base, int N, typename... Interfaces>
+using multi_poly_union = basic_poly_union<Base, N, multi_interface_storage<N, Base, Interfaces...>>;
+
+#endif
@@ -0,0 +1,330 @@
+#ifndef OFFSET_ARENA_HPP
+#define OFFSET_ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "polymorphic_movable.hpp"
+#include "trivially_relocatable.hpp"
+
+/**
+ * offset_arena stores polymorphic values of Base in a single growable block
+ * and identifies them by 32-bit offsets instead of pointers.  Offsets are
+ * counted in units of the alignment, hence an arena may hold up to 64 GiB.
+ *
+ * Every value is preceded by a header with its size and the address of its
+ * owner, a 64-bit word that contains the offset in its upper half.  Growing
+ * the arena moves all values to a new block at the same offsets.  compact()
+ * moves the values down over released ones and rewrites the offsets in their
+ * owners, which have to be updated with set_owner when they move.  allocate
+ * compacts instead of growing if at least half of the arena was released, so
+ * the arena stays within twice the size of its live values under churn.
+ * Hence allocating may move every value and invalidates pointers into the
+ * arena, but not offsets stored in owners.
+ *
+ * Values are moved with memcpy for trivially relocatable hierarchies and
+ * with polymorphic_movable otherwise.
+ *
+ * instance() returns one arena per Base, Tag, and thread, so arenas need no
+ * synchronization.  Values may therefore not cross threads: a value has to
+ * be created, used, and destroyed by the same thread.  An arena that still
+ * holds values when its thread exits, e.g., values of static owners that
+ * are destroyed after thread_local objects, is deleted by the release of its
+ * last value.
+ */
+template <typename Base, typename Tag = Base>
+struct offset_arena
+{
+    static_assert(std::is_base_of_v<polymorphic_movable, Base> || is_trivially_relocatable_hierarchy<Base>::value,
+                  "Values in an offset_arena have to be relocatable");
+
+    static std::size_t constexpr alignment = 16;
+
+    // The arena of the calling thread.
+    static offset_arena & instance()
+    {
+        if (current_ == nullptr)
+        {
+            current_ = new offset_arena;
+            if (thread_exited_)
+            {
+                current_->is_orphaned_ = true;
+            }
+            else
+            {
+                delete_at_thread_exit();
+            }
+        }
+        return *current_;
+    }
+
+    offset_arena() = default;
+
+    // Values that remain in the arena are not destroyed.
+    ~offset_arena()
+    {
+        ::operator delete(data_, std::align_val_t(alignment));
+    }
+
+    offset_arena(offset_arena const &) = delete;
+    offset_arena & operator=(offset_arena const &) = delete;
+
+    // Reserve memory for a value of size bytes whose offset is stored in
+    // owner.  The value has to be constructed at pointer(result).
+    std::uint32_t allocate(std::size_t size, std::byte * owner)
+    {
+        std::size_t const block_size = HeaderSize + round_up(size);
+        if (capacity_ - size_ < block_size && size_ - live_size_ >= size_ / 2)
+        {
+            compact();
+        }
+        if (capacity_ - size_ < block_size)
+        {
+            grow(size_ + block_size);
+        }
+
+        std::size_t const position = size_;
+        ::new (data_ + position) header { static_cast<std::uint32_t>(block_size / alignment), owner };
+        size_ += block_size;
+        live_size_ += block_size;
+        return static_cast<std::uint32_t>((position + HeaderSize) / alignment);
+    }
+
+    // Give back the memory of a value that was destroyed already.
+    void release(std::uint32_t offset)
+    {
+        header * h = header_of(offset);
+        std::size_t const block_size = h->size * alignment;
+        h->owner = nullptr;
+        live_size_ -= block_size;
+        if (reinterpret_cast<std::byte *>(h) + block_size == data_ + size_)
+        {
+            size_ -= block_size;
+        }
+
+        if (is_orphaned_ && live_size_ == 0)
+        {
+            if (current_ == this)
+            {
+                current_ = nullptr;
+            }
+            delete this;
+        }
+    }
+
+    void set_owner(std::uint32_t offset, std::byte * owner)
+    {
+        header_of(offset)->owner = owner;
+    }
+
+    // Whether offset refers to a value of owner in this arena, e.g., to
+    // assert that values do not cross threads.
+    bool is_owned_by(std::uint32_t offset, std::byte const * owner) const
+    {
+        std::size_t const position = std::size_t(offset) * alignment;
+        return position >= HeaderSize && position < size_ && header_of(offset)->owner == owner;
+    }
+
+    // Size of the block of a value, at least as large as the value itself.
+    std::size_t block_size(std::uint32_t offset) const
+    {
+        return header_of(offset)->size * alignment - HeaderSize;
+    }
+
+    Base * pointer(std::uint32_t offset)
+    {
+        return std::launder(reinterpret_cast<Base *>(data_ + std::size_t(offset) * alignment));
+    }
+
+    Base const * pointer(std::uint32_t offset) const
+    {
+        return std::launder(reinterpret_cast<Base const *>(data_ + std::size_t(offset) * alignment));
+    }
+
+    // Move all values to the start of the arena and update their owners.
+    void compact()
+    {
+        std::size_t target = 0;
+        for (std::size_t position = 0; position < size_;)
+        {
+            header * h = std::launder(reinterpret_cast<header *>(data_ + position));
+            std::size_t const block_size = h->size * alignment;
+            if (h->owner != nullptr)
+            {
+                if (target != position)
+                {
+                    header moved = *h;
+                    relocate(data_ + position + HeaderSize, data_ + target + HeaderSize, block_size - HeaderSize);
+                    ::new (data_ + target) header(moved);
+                    write_offset(moved.owner, static_cast<std::uint32_t>((target + HeaderSize) / alignment));
+                }
+                target += block_size;
+            }
+            position += block_size;
+        }
+        size_ = target;
+    }
+
+    // Bytes in use including released values that have not been compacted.
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    // Bytes of values that were not released.
+    std::size_t live_size() const
+    {
+        return live_size_;
+    }
+
+    std::size_t capacity() const
+    {
+        return capacity_;
+    }
+
+    // Store offset in the upper half of an owner word.
+    static void write_offset(std::byte * owner, std::uint32_t offset)
+    {
+        std::uint64_t word;
+        std::memcpy(&word, owner, sizeof(word));
+        word = (word & 0xffffffffu) | (std::uint64_t(offset) << 32);
+        std::memcpy(owner, &word, sizeof(word));
+    }
+
+    private:
+
+    struct header
+    {
+        // in units of alignment, including the header
+        std::uint32_t size;
+        std::byte * owner;
+    };
+
+    // Values start after a header, at the next multiple of the alignment.
+    static std::size_t constexpr HeaderSize = alignment;
+    static_assert(sizeof(header) <= HeaderSize);
+
+    // Trivially destructible, so they may still be used by owners that are
+    // destroyed after the thread_local objects of their thread.
+    static inline thread_local offset_arena * current_ = nullptr;
+    static inline thread_local bool thread_exited_ = false;
+
+    // Delete the arena of this thread when it exits, or orphan it if it
+    // still holds values.
+    static void delete_at_thread_exit()
+    {
+        struct thread_exit
+        {
+            ~thread_exit()
+            {
+                thread_exited_ = true;
+                if (current_ != nullptr)
+                {
+                    if (current_->live_size_ == 0)
+                    {
+                        delete std::exchange(current_, nullptr);
+                    }
+                    else
+                    {
+                        current_->is_orphaned_ = true;
+                    }
+                }
+            }
+        };
+        thread_local thread_exit guard;
+        (void)guard;
+    }
+
+    static std::size_t round_up(std::size_t size)
+    {
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
+    header * header_of(std::uint32_t offset) const
+    {
+        return std::launder(reinterpret_cast<header *>(data_ + std::size_t(offset) * alignment - HeaderSize));
+    }
+
+    // Move a value of at most size bytes to a lower address.
+    static void relocate(std::byte * from, std::byte * to, std::size_t size)
+    {
+        if constexpr (is_trivially_relocatable_hierarchy<Base>::value)
+        {
+            std::memmove(to, from, size);
+        }
+        else
+        {
+            Base * value = std::launder(reinterpret_cast<Base *>(from));
+            if (to + size > from)
+            {
+                // The object representations overlap, move through a
+                // temporary.
+                std::byte * tmp = static_cast<std::byte *>(::operator new(size, std::align_val_t(alignment)));
+                static_cast<polymorphic_movable *>(value)->polymorphic_move_construct_in_place(tmp);
+                value->~Base();
+                value = std::launder(reinterpret_cast<Base *>(tmp));
+                static_cast<polymorphic_movable *>(value)->polymorphic_move_construct_in_place(to);
+                value->~Base();
+                ::operator delete(tmp, std::align_val_t(alignment));
+            }
+            else
+            {
+                static_cast<polymorphic_movable *>(value)->polymorphic_move_construct_in_place(to);
+                value->~Base();
+            }
+        }
+    }
+
+    void grow(std::size_t minimum)
+    {
+        std::size_t capacity = capacity_ == 0 ? 4096 : capacity_ * 2;
+        while (capacity < minimum)
+        {
+            capacity *= 2;
+        }
+        if (capacity / alignment > UINT32_MAX)
+        {
+            throw std::length_error("offset_arena: offsets exceed 32 bits");
+        }
+
+        std::byte * data = static_cast<std::byte *>(::operator new(capacity, std::align_val_t(alignment)));
+        if constexpr (is_trivially_relocatable_hierarchy<Base>::value)
+        {
+            if (size_ != 0)
+            {
+                std::memcpy(data, data_, size_);
+            }
+        }
+        else
+        {
+            for (std::size_t position = 0; position < size_;)
+            {
+                header const * h = std::launder(reinterpret_cast<header const *>(data_ + position));
+                ::new (data + position) header(*h);
+                if (h->owner != nullptr)
+                {
+                    Base * value = std::launder(reinterpret_cast<Base *>(data_ + position + HeaderSize));
+                    static_cast<polymorphic_movable *>(value)->polymorphic_move_construct_in_place(data + position + HeaderSize);
+                    value->~Base();
+                }
+                position += h->size * alignment;
+            }
+        }
+        ::operator delete(data_, std::align_val_t(alignment));
+        data_ = data;
+        capacity_ = capacity;
+    }
+
+    std::byte * data_ = nullptr;
+    std::size_t size_ = 0;
+    std::size_t live_size_ = 0;
+    std::size_t capacity_ = 0;
+    bool is_orphaned_ = false;
+};
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef POLY_ARENA_HPP
+#define POLY_ARENA_HPP
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+/**
+ * poly_arena is a single block of memory of fixed capacity from which objects
+ * are allocated in order.  Memory is only released when the arena is
+ * destroyed, objects inside it are not destroyed by the arena.  Every object
+ * is aligned like memory returned by operator new.
+ */
+struct poly_arena
+{
+    static std::size_t constexpr alignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+    poly_arena() = default;
+
+    explicit poly_arena(std::size_t capacity)
+        : begin_(capacity == 0 ? nullptr : static_cast<std::byte *>(::operator new(capacity, std::align_val_t(alignment))))
+        , capacity_(capacity)
+    {
+    }
+
+    ~poly_arena()
+    {
+        if (begin_ != nullptr)
+        {
+            ::operator delete(begin_, std::align_val_t(alignment));
+        }
+    }
+
+    poly_arena(poly_arena && other) noexcept
+        : begin_(std::exchange(other.begin_, nullptr))
+        , size_(std::exchange(other.size_, 0))
+        , capacity_(std::exchange(other.capacity_, 0))
+    {
+    }
+
+    poly_arena & operator=(poly_arena && other) noexcept
+    {
+        if (this != &other)
+        {
+            if (begin_ != nullptr)
+            {
+                ::operator delete(begin_, std::align_val_t(alignment));
+            }
+            begin_ = std::exchange(other.begin_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+            capacity_ = std::exchange(other.capacity_, 0);
+        }
+        return *this;
+    }
+
+    poly_arena(poly_arena const &) = delete;
+    poly_arena & operator=(poly_arena const &) = delete;
+
+    static std::size_t constexpr aligned_size(std::size_t size)
+    {
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
+    // Returns nullptr if there is not enough space left.
+    std::byte * allocate(std::size_t size)
+    {
+        std::size_t const n = aligned_size(size);
+        if (capacity_ - size_ < n)
+        {
+            return nullptr;
+        }
+        std::byte * result = begin_ + size_;
+        size_ += n;
+        return result;
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    std::size_t capacity() const
+    {
+        return capacity_;
+    }
+
+    private:
+
+    std::byte * begin_ = nullptr;
+    std::size_t size_ = 0;
+    std::size_t capacity_ = 0;
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef POLY_FIELDS_HPP
+#define POLY_FIELDS_HPP
+
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+/**
+ * Types that are stored outside of the process, e.g., in a file, list their
+ * trivially copyable members with a poly_fields hidden friend that returns
+ * references to them:
+ *
+ *     friend auto poly_fields(point & self)
+ *     {
+ *         return std::tie(self.x, self.y);
+ *     }
+ *
+ * This lets a value be rebuilt from its members in another process without
+ * ever taking the vptr or padding from foreign bytes.  The function is only
+ * used to read the members of a value or to assign them to a default
+ * constructed one.
+ */
+template <typename T>
+concept has_poly_fields = requires (T & v)
+{
+    poly_fields(v);
+};
+
+template <typename T>
+using poly_fields_type = decltype(poly_fields(std::declval<T &>()));
+
+template <typename Tuple>
+struct poly_fields_traits;
+
+template <typename... Fields>
+struct poly_fields_traits<std::tuple<Fields...>>
+{
+    typedef std::tuple<std::remove_cvref_t<Fields>...> values_type;
+    static std::size_t constexpr size = (std::size_t(0) + ... + sizeof(std::remove_cvref_t<Fields>));
+};
+
+// The members of T by value.
+template <has_poly_fields T>
+using poly_field_values = typename poly_fields_traits<poly_fields_type<T>>::values_type;
+
+// Size of the members of T returned by poly_fields.
+template <has_poly_fields T>
+constexpr std::size_t poly_payload_size()
+{
+    return poly_fields_traits<poly_fields_type<T>>::size;
+}
+
+#endif
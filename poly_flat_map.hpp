@@ -0,0 +1,350 @@
+#ifndef POLY_FLAT_MAP_HPP
+#define POLY_FLAT_MAP_HPP
+
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "bounded_storage.hpp"
+#include "trivially_relocatable.hpp"
+
+/**
+ * poly_flat_map is a hash map from Key to polymorphic values of Base with
+ * bounded storage size.  Keys and values are stored inline in a single array
+ * with open addressing, so a lookup usually touches a single cache line and
+ * inserting does not allocate unless the table grows.
+ *
+ * Collisions are resolved with Robin Hood hashing: each slot stores its
+ * distance from the slot the key hashes to, and an insertion takes the slot
+ * of the first entry that is closer to its own.  The entries after it are
+ * shifted by one slot, so new values are constructed in place.  Erasing
+ * shifts the following entries back instead of leaving tombstones.  The
+ * table grows at a load factor of 3/4, which keeps probes, and hence the
+ * entries a miss reads, short.
+ *
+ * Entries are relocated on insertion, erasure, and rehashing.  This uses
+ * memcpy if the hierarchy is declared trivially relocatable and Key is
+ * trivially copyable, otherwise Base has to implement polymorphic_movable.
+ * The pointers returned by find and try_emplace are invalidated by these
+ * operations.  The map itself may be moved but not copied.
+ */
+template <typename Key, typename Base, int N, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
+requires storage_size_at_most<Base, N>
+struct poly_flat_map
+{
+    typedef bounded_storage<N, Base> storage_type;
+
+    poly_flat_map() = default;
+
+    ~poly_flat_map()
+    {
+        clear();
+    }
+
+    poly_flat_map(poly_flat_map && other) noexcept
+        : slots_(std::move(other.slots_))
+        , capacity_(std::exchange(other.capacity_, 0))
+        , size_(std::exchange(other.size_, 0))
+        , shift_(other.shift_)
+        , hash_(std::move(other.hash_))
+        , equal_(std::move(other.equal_))
+    {
+    }
+
+    poly_flat_map & operator=(poly_flat_map && other) noexcept
+    {
+        if (this != &other)
+        {
+            clear();
+            slots_ = std::move(other.slots_);
+            capacity_ = std::exchange(other.capacity_, 0);
+            size_ = std::exchange(other.size_, 0);
+            shift_ = other.shift_;
+            hash_ = std::move(other.hash_);
+            equal_ = std::move(other.equal_);
+        }
+        return *this;
+    }
+
+    poly_flat_map(poly_flat_map const &) = delete;
+    poly_flat_map & operator=(poly_flat_map const &) = delete;
+
+    // Construct a Derived for key unless key is present.  Returns the value
+    // of key and whether it was constructed.
+    template <std::derived_from<Base> Derived, typename... Args>
+    std::pair<Base *, bool> try_emplace(Key key, Args &&... args)
+    {
+        if (size_ + 1 > capacity_ / 4 * 3)
+        {
+            rehash(capacity_ == 0 ? MinimumCapacity : capacity_ * 2);
+        }
+
+        std::size_t i = home(key);
+        std::uint32_t distance = 1;
+        while (slots_[i].distance >= distance)
+        {
+            if (slots_[i].distance == distance && equal_(slots_[i].e.key, key))
+            {
+                return { slots_[i].e.value.pointer(), false };
+            }
+            i = next(i);
+            ++distance;
+        }
+        make_room(i);
+
+        try
+        {
+            ::new (&slots_[i].e) entry { std::move(key), storage_type(std::type_identity<Derived>{}, std::forward<Args>(args)...) };
+        }
+        catch (...)
+        {
+            close_gap(i);
+            throw;
+        }
+        slots_[i].distance = distance;
+        ++size_;
+        return { slots_[i].e.value.pointer(), true };
+    }
+
+    Base * find(Key const & key)
+    {
+        std::size_t const i = index_of(key);
+        return i == capacity_ ? nullptr : slots_[i].e.value.pointer();
+    }
+
+    Base const * find(Key const & key) const
+    {
+        std::size_t const i = index_of(key);
+        return i == capacity_ ? nullptr : slots_[i].e.value.pointer();
+    }
+
+    bool contains(Key const & key) const
+    {
+        return index_of(key) != capacity_;
+    }
+
+    // Returns whether key was present.
+    bool erase(Key const & key)
+    {
+        std::size_t const i = index_of(key);
+        if (i == capacity_)
+        {
+            return false;
+        }
+        slots_[i].e.~entry();
+        close_gap(i);
+        --size_;
+        return true;
+    }
+
+    // Calls f(key, value) for every entry in unspecified order.
+    template <typename F>
+    void for_each(F f)
+    {
+        for (std::size_t i = 0; i < capacity_; ++i)
+        {
+            if (slots_[i].distance != 0)
+            {
+                f(std::as_const(slots_[i].e.key), *slots_[i].e.value.pointer());
+            }
+        }
+    }
+
+    template <typename F>
+    void for_each(F f) const
+    {
+        for (std::size_t i = 0; i < capacity_; ++i)
+        {
+            if (slots_[i].distance != 0)
+            {
+                f(slots_[i].e.key, *slots_[i].e.value.pointer());
+            }
+        }
+    }
+
+    void clear()
+    {
+        for (std::size_t i = 0; i < capacity_; ++i)
+        {
+            if (slots_[i].distance != 0)
+            {
+                slots_[i].e.~entry();
+                slots_[i].distance = 0;
+            }
+        }
+        size_ = 0;
+    }
+
+    // Make room for n entries without rehashing.
+    void reserve(std::size_t n)
+    {
+        std::size_t const capacity = std::bit_ceil(n + n / 3 + 1);
+        if (capacity > capacity_)
+        {
+            rehash(capacity < MinimumCapacity ? MinimumCapacity : capacity);
+        }
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    std::size_t capacity() const
+    {
+        return capacity_;
+    }
+
+    private:
+
+    struct entry
+    {
+        Key key;
+        storage_type value;
+    };
+
+    // distance is 0 for empty slots and otherwise 1 + the distance from the
+    // slot the key hashes to.  It fits into the padding before the entry.
+    struct slot
+    {
+        slot()
+        {
+        }
+
+        ~slot()
+        {
+        }
+
+        std::uint32_t distance = 0;
+        union
+        {
+            entry e;
+        };
+    };
+
+    static std::size_t constexpr MinimumCapacity = 8;
+
+    std::size_t home(Key const & key) const
+    {
+        // Fibonacci hashing spreads the bits of weak hashes, e.g., the
+        // identity of std::hash for integers.
+        return static_cast<std::size_t>((static_cast<std::uint64_t>(hash_(key)) * 0x9e3779b97f4a7c15u) >> shift_);
+    }
+
+    std::size_t next(std::size_t i) const
+    {
+        return (i + 1) & (capacity_ - 1);
+    }
+
+    // Returns capacity_ if key is not present.
+    std::size_t index_of(Key const & key) const
+    {
+        if (size_ == 0)
+        {
+            return capacity_;
+        }
+        std::size_t i = home(key);
+        for (std::uint32_t distance = 1; slots_[i].distance >= distance; ++distance)
+        {
+            if (slots_[i].distance == distance && equal_(slots_[i].e.key, key))
+            {
+                return i;
+            }
+            i = next(i);
+        }
+        return capacity_;
+    }
+
+    static void relocate(slot & from, slot & to)
+    {
+        if constexpr (is_trivially_relocatable_hierarchy<Base>::value && std::is_trivially_copyable_v<Key>)
+        {
+            std::memcpy(static_cast<void *>(&to.e), static_cast<void const *>(&from.e), sizeof(entry));
+        }
+        else
+        {
+            ::new (&to.e) entry(std::move(from.e));
+            from.e.~entry();
+        }
+    }
+
+    // Shift the entries from slot i up to the next empty slot by one.
+    void make_room(std::size_t i)
+    {
+        std::size_t last = i;
+        while (slots_[last].distance != 0)
+        {
+            last = next(last);
+        }
+        while (last != i)
+        {
+            std::size_t const previous = (last - 1) & (capacity_ - 1);
+            relocate(slots_[previous], slots_[last]);
+            slots_[last].distance = slots_[previous].distance + 1;
+            last = previous;
+        }
+        slots_[i].distance = 0;
+    }
+
+    // Slot i is empty, shift the following entries back until one is in the
+    // slot it hashes to.
+    void close_gap(std::size_t i)
+    {
+        std::size_t j = next(i);
+        while (slots_[j].distance > 1)
+        {
+            relocate(slots_[j], slots_[i]);
+            slots_[i].distance = slots_[j].distance - 1;
+            i = j;
+            j = next(j);
+        }
+        slots_[i].distance = 0;
+    }
+
+    void rehash(std::size_t capacity)
+    {
+        // Allocates before the map is changed.
+        std::unique_ptr<slot[]> old_slots = std::exchange(slots_, std::make_unique<slot[]>(capacity));
+        std::size_t const old_capacity = capacity_;
+        capacity_ = capacity;
+        shift_ = 64 - std::countr_zero(capacity);
+
+        for (std::size_t j = 0; j < old_capacity; ++j)
+        {
+            if (old_slots[j].distance != 0)
+            {
+                std::size_t i = home(old_slots[j].e.key);
+                std::uint32_t distance = 1;
+                while (slots_[i].distance >= distance)
+                {
+                    i = next(i);
+                    ++distance;
+                }
+                make_room(i);
+                relocate(old_slots[j], slots_[i]);
+                slots_[i].distance = distance;
+            }
+        }
+    }
+
+    std::unique_ptr<slot[]> slots_;
+    std::size_t capacity_ = 0;
+    std::size_t size_ = 0;
+    int shift_ = 64;
+    [[no_unique_address]] Hash hash_;
+    [[no_unique_address]] KeyEqual equal_;
+};
+
+#endif
@@ -0,0 +1,305 @@
+#ifndef POLY_PRIORITY_QUEUE_HPP
+#define POLY_PRIORITY_QUEUE_HPP
+
+#include <cassert>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "bounded_storage.hpp"
+#include "trivially_relocatable.hpp"
+
+/**
+ * poly_priority_queue is a priority queue of polymorphic values of Base with
+ * bounded storage size, ordered by a time stamp, e.g., the events of a
+ * discrete-event simulation.  Values are stored inline in the nodes of a
+ * D-ary heap, so scheduling does not allocate unless the heap grows.  Values
+ * with equal time stamps are dequeued in the order they were scheduled.
+ *
+ * emplace<Derived>(time, args...) constructs a value directly at its final
+ * position in the heap.  pop_and_run(f) moves the earliest value out of the
+ * heap and calls f(time, value) with it.  f may schedule new values.
+ *
+ * Nodes are relocated by the sift operations with memcpy if the hierarchy is
+ * declared trivially relocatable and Time is trivially copyable, otherwise
+ * Base has to implement polymorphic_movable.  A larger D results in fewer
+ * levels and hence fewer relocations, but more comparisons per level.
+ */
+template <typename Time, typename Base, int N, int D = 4, typename Compare = std::less<Time>>
+requires storage_size_at_most<Base, N> && (D >= 2)
+struct poly_priority_queue
+{
+    typedef bounded_storage<N, Base> storage_type;
+
+    poly_priority_queue() = default;
+
+    ~poly_priority_queue()
+    {
+        clear();
+    }
+
+    poly_priority_queue(poly_priority_queue && other) noexcept
+        : nodes_(std::move(other.nodes_))
+        , capacity_(std::exchange(other.capacity_, 0))
+        , size_(std::exchange(other.size_, 0))
+        , sequence_(other.sequence_)
+        , compare_(std::move(other.compare_))
+    {
+    }
+
+    poly_priority_queue & operator=(poly_priority_queue && other) noexcept
+    {
+        if (this != &other)
+        {
+            clear();
+            nodes_ = std::move(other.nodes_);
+            capacity_ = std::exchange(other.capacity_, 0);
+            size_ = std::exchange(other.size_, 0);
+            sequence_ = other.sequence_;
+            compare_ = std::move(other.compare_);
+        }
+        return *this;
+    }
+
+    poly_priority_queue(poly_priority_queue const &) = delete;
+    poly_priority_queue & operator=(poly_priority_queue const &) = delete;
+
+    template <std::derived_from<Base> Derived, typename... Args>
+    void emplace(Time time, Args &&... args)
+    {
+        if (size_ == capacity_)
+        {
+            reallocate(capacity_ == 0 ? MinimumCapacity : capacity_ * 2);
+        }
+
+        std::uint64_t const sequence = sequence_++;
+        std::size_t i = size_;
+        while (i > 0)
+        {
+            std::size_t const p = parent(i);
+            if (!earlier(time, sequence, nodes_[p].n))
+            {
+                break;
+            }
+            relocate(nodes_[p], nodes_[i]);
+            i = p;
+        }
+
+        try
+        {
+            ::new (&nodes_[i].n) node { std::move(time), sequence, storage_type(std::type_identity<Derived>{}, std::forward<Args>(args)...) };
+        }
+        catch (...)
+        {
+            // Move the parents back down again.
+            while (i != size_)
+            {
+                std::size_t c = size_;
+                while (parent(c) != i)
+                {
+                    c = parent(c);
+                }
+                relocate(nodes_[c], nodes_[i]);
+                i = c;
+            }
+            throw;
+        }
+        ++size_;
+    }
+
+    // Remove the earliest value and call f(time, value) with it.
+    template <typename F>
+    void pop_and_run(F && f)
+    {
+        assert(size_ != 0);
+
+        slot current;
+        relocate(nodes_[0], current);
+
+        // The node is only destroyed once it was relocated, if relocating
+        // throws it stays at the top.
+        struct node_guard
+        {
+            ~node_guard()
+            {
+                n.~node();
+            }
+
+            node & n;
+        } guard { current.n };
+        remove_top();
+        std::forward<F>(f)(std::as_const(current.n.time), *current.n.value.pointer());
+    }
+
+    // Remove the earliest value without running it.
+    void pop()
+    {
+        assert(size_ != 0);
+
+        nodes_[0].n.~node();
+        remove_top();
+    }
+
+    Base & top()
+    {
+        return *nodes_[0].n.value.pointer();
+    }
+
+    Base const & top() const
+    {
+        return *nodes_[0].n.value.pointer();
+    }
+
+    Time const & top_time() const
+    {
+        return nodes_[0].n.time;
+    }
+
+    void clear()
+    {
+        for (std::size_t i = 0; i < size_; ++i)
+        {
+            nodes_[i].n.~node();
+        }
+        size_ = 0;
+    }
+
+    void reserve(std::size_t n)
+    {
+        if (n > capacity_)
+        {
+            reallocate(n);
+        }
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    private:
+
+    struct node
+    {
+        Time time;
+        std::uint64_t sequence;
+        storage_type value;
+    };
+
+    struct slot
+    {
+        slot()
+        {
+        }
+
+        ~slot()
+        {
+        }
+
+        union
+        {
+            node n;
+        };
+    };
+
+    static std::size_t constexpr MinimumCapacity = 16;
+
+    static std::size_t parent(std::size_t i)
+    {
+        return (i - 1) / D;
+    }
+
+    bool earlier(Time const & time, std::uint64_t sequence, node const & other) const
+    {
+        if (compare_(time, other.time))
+        {
+            return true;
+        }
+        return !compare_(other.time, time) && sequence < other.sequence;
+    }
+
+    bool earlier(node const & a, node const & b) const
+    {
+        return earlier(a.time, a.sequence, b);
+    }
+
+    static void relocate(slot & from, slot & to)
+    {
+        if constexpr (is_trivially_relocatable_hierarchy<Base>::value && std::is_trivially_copyable_v<Time>)
+        {
+            std::memcpy(static_cast<void *>(&to.n), static_cast<void const *>(&from.n), sizeof(node));
+        }
+        else
+        {
+            ::new (&to.n) node(std::move(from.n));
+            from.n.~node();
+        }
+    }
+
+    // The top node was moved out, move the last node into its place.
+    void remove_top()
+    {
+        --size_;
+        if (size_ == 0)
+        {
+            return;
+        }
+
+        slot & last = nodes_[size_];
+        std::size_t i = 0;
+        while (true)
+        {
+            std::size_t const first_child = D * i + 1;
+            if (first_child >= size_)
+            {
+                break;
+            }
+            std::size_t const end_child = first_child + D < size_ ? first_child + D : size_;
+            std::size_t c = first_child;
+            for (std::size_t j = first_child + 1; j < end_child; ++j)
+            {
+                if (earlier(nodes_[j].n, nodes_[c].n))
+                {
+                    c = j;
+                }
+            }
+            if (!earlier(nodes_[c].n, last.n))
+            {
+                break;
+            }
+            relocate(nodes_[c], nodes_[i]);
+            i = c;
+        }
+        relocate(last, nodes_[i]);
+    }
+
+    void reallocate(std::size_t capacity)
+    {
+        std::unique_ptr<slot[]> nodes = std::make_unique<slot[]>(capacity);
+        for (std::size_t i = 0; i < size_; ++i)
+        {
+            relocate(nodes_[i], nodes[i]);
+        }
+        nodes_ = std::move(nodes);
+        capacity_ = capacity;
+    }
+
+    std::unique_ptr<slot[]> nodes_;
+    std::size_t capacity_ = 0;
+    std::size_t size_ = 0;
+    std::uint64_t sequence_ = 0;
+    [[no_unique_address]] Compare compare_;
+};
+
+#endif
@@ -0,0 +1,278 @@
+#ifndef POLY_RUN_VECTOR_HPP
+#define POLY_RUN_VECTOR_HPP
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <iterator>
+#include <typeinfo>
+#include <vector>
+
+#include "poly_union.hpp"
+
+/**
+ * strided_span is a view of count objects of type T that are Stride bytes
+ * apart.  Since Stride is known at compile-time, loops over it may be
+ * unrolled and vectorized like loops over arrays.
+ */
+template <typename T, std::size_t Stride>
+struct strided_span
+{
+    struct iterator
+    {
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef T * pointer;
+        typedef T & reference;
+
+        T & operator*() const
+        {
+            return *p;
+        }
+
+        T * operator->() const
+        {
+            return p;
+        }
+
+        T & operator[](std::ptrdiff_t n) const
+        {
+            return *(*this + n);
+        }
+
+        iterator & operator++()
+        {
+            return *this += 1;
+        }
+
+        iterator operator++(int)
+        {
+            iterator result = *this;
+            ++*this;
+            return result;
+        }
+
+        iterator & operator--()
+        {
+            return *this -= 1;
+        }
+
+        iterator operator--(int)
+        {
+            iterator result = *this;
+            --*this;
+            return result;
+        }
+
+        iterator & operator+=(std::ptrdiff_t n)
+        {
+            p = advance(p, n);
+            return *this;
+        }
+
+        iterator & operator-=(std::ptrdiff_t n)
+        {
+            return *this += -n;
+        }
+
+        friend iterator operator+(iterator it, std::ptrdiff_t n)
+        {
+            return it += n;
+        }
+
+        friend iterator operator+(std::ptrdiff_t n, iterator it)
+        {
+            return it += n;
+        }
+
+        friend iterator operator-(iterator it, std::ptrdiff_t n)
+        {
+            return it -= n;
+        }
+
+        friend std::ptrdiff_t operator-(iterator a, iterator b)
+        {
+            return (reinterpret_cast<char const *>(a.p) - reinterpret_cast<char const *>(b.p)) / static_cast<std::ptrdiff_t>(Stride);
+        }
+
+        friend auto operator<=>(iterator const &, iterator const &) = default;
+
+        T * p = nullptr;
+    };
+
+    T & operator[](std::size_t i) const
+    {
+        return *advance(first_, static_cast<std::ptrdiff_t>(i));
+    }
+
+    iterator begin() const
+    {
+        return { first_ };
+    }
+
+    iterator end() const
+    {
+        return { advance(first_, static_cast<std::ptrdiff_t>(count_)) };
+    }
+
+    std::size_t size() const
+    {
+        return count_;
+    }
+
+    bool empty() const
+    {
+        return count_ == 0;
+    }
+
+    T * first_;
+    std::size_t count_;
+
+    private:
+
+    static T * advance(T * p, std::ptrdiff_t n)
+    {
+        return reinterpret_cast<T *>(reinterpret_cast<char *>(p) + n * static_cast<std::ptrdiff_t>(Stride));
+    }
+};
+
+/**
+ * poly_run_vector is an append-only sequence of poly_union that keeps track
+ * of runs of consecutive elements of the same type.
+ *
+ * emplace_back_n constructs many elements of the same type at once without
+ * any virtual calls.  typed_spans returns the runs of a type as views of the
+ * concrete type, so kernels may call its functions non-virtually, which
+ * permits inlining and vectorization.  Elements are Stride bytes apart, the
+ * size of poly_union<Base, N>, hence the views are strided.  To keep the
+ * runs consistent, elements can only be accessed through Base.
+ */
+template <typename Base, int N>
+struct poly_run_vector
+{
+    typedef poly_union<Base, N> value_type;
+
+    template <typename Derived>
+    using typed_span = strided_span<Derived, sizeof(value_type)>;
+
+    template <std::derived_from<Base> Derived, typename... Args>
+    void emplace_back(Args &&... args)
+    {
+        values_.emplace_back(std::type_identity<Derived>{}, std::forward<Args>(args)...);
+        try
+        {
+            extend_run<Derived>(1);
+        }
+        catch (...)
+        {
+            values_.pop_back();
+            throw;
+        }
+    }
+
+    // Construct n elements of type Derived, each from a copy of args.
+    template <std::derived_from<Base> Derived, typename... Args>
+    void emplace_back_n(std::size_t n, Args const &... args)
+    {
+        if (values_.size() + n > values_.capacity())
+        {
+            // Grow geometrically, so repeated batches take amortized linear
+            // time.
+            values_.reserve(std::max(values_.size() + n, 2 * values_.capacity()));
+        }
+        std::size_t const size = values_.size();
+        try
+        {
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                values_.emplace_back(std::type_identity<Derived>{}, args...);
+            }
+            extend_run<Derived>(n);
+        }
+        catch (...)
+        {
+            // Elements that are not covered by a run would be taken for
+            // elements of the next run.
+            while (values_.size() != size)
+            {
+                values_.pop_back();
+            }
+            throw;
+        }
+    }
+
+    // All runs of exactly type Derived, in order.
+    template <std::derived_from<Base> Derived>
+    std::vector<typed_span<Derived>> typed_spans()
+    {
+        std::vector<typed_span<Derived>> result;
+        for (run const & r : runs_)
+        {
+            if (*r.type == typeid(Derived))
+            {
+                Derived * first = static_cast<Derived *>(values_[r.begin].pointer());
+                result.push_back({ first, r.end - r.begin });
+            }
+        }
+        return result;
+    }
+
+    Base & operator[](std::size_t i)
+    {
+        return values_[i].get();
+    }
+
+    Base const & operator[](std::size_t i) const
+    {
+        return values_[i].get();
+    }
+
+    std::size_t size() const
+    {
+        return values_.size();
+    }
+
+    std::size_t run_count() const
+    {
+        return runs_.size();
+    }
+
+    void reserve(std::size_t n)
+    {
+        values_.reserve(n);
+    }
+
+    void clear()
+    {
+        values_.clear();
+        runs_.clear();
+    }
+
+    private:
+
+    struct run
+    {
+        std::type_info const * type;
+        std::size_t begin;
+        std::size_t end;
+    };
+
+    template <typename Derived>
+    void extend_run(std::size_t n)
+    {
+        if (!runs_.empty() && *runs_.back().type == typeid(Derived))
+        {
+            runs_.back().end += n;
+        }
+        else
+        {
+            runs_.push_back({ &typeid(Derived), values_.size() - n, values_.size() });
+        }
+    }
+
+    std::vector<value_type> values_;
+    std::vector<run> runs_;
+};
+
+#endif
@@ -0,0 +1,213 @@
+#ifndef POLY_UNION_ALGORITHM_HPP
+#define POLY_UNION_ALGORITHM_HPP
+
+#include <cstddef>
+#include <iterator>
+#include <ranges>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#include "poly_arena.hpp"
+
+/**
+ * Reorder a range so that elements with the same key are adjacent, in
+ * ascending order of keys in [0, key_count).  The order within a group is
+ * not preserved.  Every element is swapped at most once into its final
+ * position, hence this relies on a cheap swap.
+ *
+ * Returns the key_count + 1 boundaries of the groups, i.e., group k is
+ * [result[k], result[k + 1]).
+ */
+template <std::ranges::random_access_range Range, typename Key>
+std::vector<std::size_t> partition_by_key(Range && range, std::size_t key_count, Key key)
+{
+    auto first = std::ranges::begin(range);
+    std::size_t const size = static_cast<std::size_t>(std::ranges::size(range));
+
+    std::vector<std::size_t> bounds(key_count + 1, 0);
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        ++bounds[key(first[i]) + 1];
+    }
+    for (std::size_t k = 0; k < key_count; ++k)
+    {
+        bounds[k + 1] += bounds[k];
+    }
+
+    // next[k] is the first position of group k that has not been filled yet.
+    std::vector<std::size_t> next(bounds.begin(), bounds.end() - 1);
+    for (std::size_t k = 0; k < key_count; ++k)
+    {
+        while (next[k] < bounds[k + 1])
+        {
+            std::size_t const target = key(first[next[k]]);
+            if (target == k)
+            {
+                ++next[k];
+            }
+            else
+            {
+                using std::swap;
+                swap(first[next[k]], first[next[target]]);
+                ++next[target];
+            }
+        }
+    }
+
+    return bounds;
+}
+
+/**
+ * Group the elements of a range of poly unions by their dynamic type.  This
+ * may be used to improve branch prediction and locality of code in hot loops.
+ *
+ * Unions with an index() among a fixed list of types, e.g.,
+ * closed_poly_union, are ordered by their index and the result contains a
+ * group for every type, even empty ones.
+ * Otherwise the types are ordered by their first occurrence and the result
+ * contains only non-empty groups.  See partition_by_key for the result.
+ */
+template <std::ranges::random_access_range Range>
+std::vector<std::size_t> partition_by_type(Range && range)
+{
+    typedef std::ranges::range_value_t<Range> union_type;
+
+    if constexpr (requires (union_type const & v) { v.index(); requires union_type::type_count > 0; })
+    {
+        return partition_by_key(range, union_type::type_count, [](union_type const & v)
+        {
+            return static_cast<std::size_t>(v.index());
+        });
+    }
+    else
+    {
+        std::vector<std::type_info const *> types;
+        auto key = [&types](union_type const & v)
+        {
+            std::type_info const & type = typeid(v.get());
+            std::size_t k = 0;
+            while (k != types.size() && *types[k] != type)
+            {
+                ++k;
+            }
+            return k;
+        };
+
+        for (union_type const & v : range)
+        {
+            if (key(v) == types.size())
+            {
+                types.push_back(&typeid(v.get()));
+            }
+        }
+
+        return partition_by_key(range, types.size(), key);
+    }
+}
+
+namespace poly_union_algorithm_detail
+{
+    inline void prefetch(void const * p)
+    {
+#if defined(__GNUC__)
+        __builtin_prefetch(p);
+#else
+        (void)p;
+#endif
+    }
+
+    template <typename Union>
+    bool is_forwarded(Union const & v)
+    {
+        if constexpr (requires { v.storage().is_forwarded(); })
+        {
+            return v.storage().is_forwarded();
+        }
+        else
+        {
+            return false;
+        }
+    }
+}
+
+/**
+ * Call f on every element of a range of poly unions, e.g., of
+ * forwarding_poly_union, while prefetching the values that are forwarded to
+ * the heap distance elements ahead.  Values stored in place are not
+ * prefetched, since they are read sequentially anyway, but their vtables are
+ * prefetched half the distance ahead.  The vtables of forwarded values are
+ * not prefetched, since loading their vptr would wait for the very miss the
+ * prefetch of the value is meant to hide.
+ *
+ * The best distance depends on the work done by f and the memory latency, it
+ * should roughly be the latency divided by the time of a call to f.  If f is
+ * cheap and independent of other elements, the processor already overlaps
+ * the misses and prefetching may be slower than a plain loop, while
+ * compact_forwarded still helps (see benchmarks/prefetch.cpp).
+ */
+template <std::ranges::random_access_range Range, typename F>
+void for_each_prefetched(Range && range, F f, std::size_t distance = 8)
+{
+    namespace detail = poly_union_algorithm_detail;
+
+    auto first = std::ranges::begin(range);
+    std::size_t const size = static_cast<std::size_t>(std::ranges::size(range));
+    std::size_t const vtable_distance = distance / 2;
+
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        // Non-const access may have side effects, e.g., shared values are
+        // detached by shared_forwarding_storage.
+        if (i + distance < size && detail::is_forwarded(first[i + distance]))
+        {
+            detail::prefetch(std::as_const(first[i + distance]).pointer());
+        }
+        if (i + vtable_distance < size && !detail::is_forwarded(first[i + vtable_distance]))
+        {
+            // The vptr is the first member of the value, which is stored in
+            // the range itself.
+            void const * p = std::as_const(first[i + vtable_distance]).pointer();
+            detail::prefetch(*static_cast<void const * const *>(p));
+        }
+        f(first[i]);
+    }
+}
+
+/**
+ * Move all forwarded values of a range of forwarding_poly_union into a single
+ * new arena in the order of the range, so that iterating over them reads
+ * memory sequentially.  This requires that Base implements
+ * polymorphic_movable.  The sizes are the ones recorded by the storage when
+ * the values were constructed, see forwarding_storage::forwarded_size.
+ *
+ * The returned arena has to outlive the values in it, i.e., until they are
+ * destroyed, replaced, or moved to another arena.  Values that were already
+ * in an arena are moved as well, so the previous arena may be released
+ * afterwards.
+ */
+template <std::ranges::random_access_range Range>
+poly_arena compact_forwarded(Range && range)
+{
+    std::size_t capacity = 0;
+    for (auto const & v : range)
+    {
+        // Forwarded values that were moved from are null.
+        if (v.storage().is_forwarded() && v.pointer() != nullptr)
+        {
+            capacity += poly_arena::aligned_size(v.storage().forwarded_size());
+        }
+    }
+
+    poly_arena arena(capacity);
+    for (auto & v : range)
+    {
+        if (v.storage().is_forwarded() && v.pointer() != nullptr)
+        {
+            v.storage().relocate_forwarded(arena.allocate(v.storage().forwarded_size()));
+        }
+    }
+    return arena;
+}
+
+#endif
@@ -1,9 +1,17 @@
 #ifndef POLYMORPHIC_COPYABLE_HPP
 #define POLYMORPHIC_COPYABLE_HPP
 
+#include <concepts>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
 struct polymorphic_copyable
 {
     virtual void polymorphic_copy_construct_in_place(std::byte * storage) const = 0;
+
+    // Used to copy values that are forwarded to the heap.
+    virtual polymorphic_copyable * polymorphic_copy_construct_on_heap() const = 0;
 };
 
 template <typename T>
@@ -13,10 +21,21 @@ void generic_copy_construct_in_place(T const & v, std::byte * storage)
     ::new (storage) std::remove_reference<T>::type(v);
 }
 
+template <typename T>
+requires std::copy_constructible<T>
+polymorphic_copyable * generic_copy_construct_on_heap(T const & v)
+{
+    return new std::remove_reference<T>::type(v);
+}
+
 #define DEFINE_POLYMORPHIC_COPY() \
     void polymorphic_copy_construct_in_place(std::byte * storage) const override \
     { \
         generic_copy_construct_in_place(*this, storage); \
+    } \
+    polymorphic_copyable * polymorphic_copy_construct_on_heap() const override \
+    { \
+        return generic_copy_construct_on_heap(*this); \
     }
 
 #endif
@@ -0,0 +1,66 @@
+#ifndef POLYMORPHIC_HASHABLE_HPP
+#define POLYMORPHIC_HASHABLE_HPP
+
+#include <concepts>
+#include <cstddef>
+#include <typeinfo>
+
+/**
+ * polymorphic_hashable provides hashing and equality of values whose concrete
+ * type is unknown, e.g., for interned_storage.  Values of different types are
+ * never equal.  DEFINE_POLYMORPHIC_HASH implements it for a subclass T with
+ * operator== and a function hash_value(T const &) that is found by
+ * argument-dependent lookup.
+ *
+ * The virtual functions of the macro are instantiated where T is complete,
+ * so hash_value has to be a hidden friend of T or declared before T:
+ *
+ *     struct point : shape
+ *     {
+ *         friend std::size_t hash_value(point const & p)
+ *         {
+ *             return std::hash<int>()(p.x) ^ std::hash<int>()(p.y);
+ *         }
+ *
+ *         bool operator==(point const & other) const
+ *         {
+ *             return x == other.x && y == other.y;
+ *         }
+ *
+ *         DEFINE_POLYMORPHIC_HASH()
+ *
+ *         int x, y;
+ *     };
+ */
+struct polymorphic_hashable
+{
+    virtual std::size_t polymorphic_hash() const = 0;
+    virtual bool polymorphic_equal(polymorphic_hashable const & other) const = 0;
+};
+
+template <typename T>
+requires std::equality_comparable<T> && requires (T const & v) { { hash_value(v) } -> std::convertible_to<std::size_t>; }
+std::size_t generic_hash(T const & v)
+{
+    std::size_t const h = hash_value(v);
+    return h ^ (typeid(T).hash_code() + 0x9e3779b97f4a7c15u + (h << 6) + (h >> 2));
+}
+
+template <typename T>
+requires std::equality_comparable<T>
+bool generic_equal(T const & v, polymorphic_hashable const & other)
+{
+    return typeid(other) == typeid(T) && v == static_cast<T const &>(other);
+}
+
+#define DEFINE_POLYMORPHIC_HASH() \
+    std::size_t polymorphic_hash() const override \
+    { \
+        return generic_hash(*this); \
+    } \
+    bool polymorphic_equal(polymorphic_hashable const & other) const override \
+    { \
+        return generic_equal(*this, other); \
+    }
+
+#endif
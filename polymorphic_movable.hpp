@@ -1,28 +1,48 @@
 #ifndef POLYMORPHIC_MOVABLE_HPP
 #define POLYMORPHIC_MOVABLE_HPP
 
+#include <concepts>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
 struct polymorphic_movable
 {
     virtual void polymorphic_move_construct_in_place(std::byte * storage) = 0;
+
+    // Size of the concrete type or 0 if unknown.
+    virtual std::size_t polymorphic_size() const
+    {
+        return 0;
+    }
 };
 
 template <typename T>
 requires std::move_constructible<T>
 void generic_move_construct_in_place(T && v, std::byte * storage)
 {
-    ::new (storage) std::remove_reference<T>::type(v);
+    ::new (storage) std::remove_reference<T>::type(std::move(v));
 }
 
 #define DEFINE_POLYMORPHIC_MOVE() \
     void polymorphic_move_construct_in_place(std::byte * storage) override \
     { \
         generic_move_construct_in_place(*this, storage); \
+    } \
+    std::size_t polymorphic_size() const override \
+    { \
+        return sizeof(*this); \
     }
 
 #define DEFINE_POLYMORPHIC_MOVE_FROM_COPY() \
     void polymorphic_move_construct_in_place(std::byte * storage) override \
     { \
         generic_copy_construct_in_place(*this, storage); \
+    } \
+    std::size_t polymorphic_size() const override \
+    { \
+        return sizeof(*this); \
     }
 
 
@@ -0,0 +1,16 @@
+#ifndef REGISTERED_POLY_UNION_HPP
+#define REGISTERED_POLY_UNION_HPP
+
+#include "bounded_storage.hpp"
+#include "registered_storage.hpp"
+#include "basic_poly_union.hpp"
+
+/**
+ * registered_poly_union is a poly_union that also stores the id of its
+ * current type from type_registry<Base>, which is available from index().
+ */
+template <typename Base, int N>
+requires storage_size_at_most<Base, N>
+using registered_poly_union = basic_poly_union<Base, N, registered_storage<bounded_storage<N, Base>, Base>>;
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef REGISTERED_STORAGE_HPP
+#define REGISTERED_STORAGE_HPP
+
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#include "type_registry.hpp"
+
+/**
+ * registered_storage wraps another storage type and additionally stores the
+ * id of the current type from type_registry<Base>.  It is used as the
+ * StorageType of basic_poly_union, which then provides it as index().
+ */
+template <typename Inner, typename Base>
+struct registered_storage
+{
+    template <typename Derived, typename... Args>
+    registered_storage(std::type_identity<Derived> w, Args &&... args)
+        : inner_(w, std::forward<Args>(args)...)
+        , id_(type_registry<Base>::template id<Derived>())
+    {
+    }
+
+    registered_storage(registered_storage &&) = default;
+    registered_storage(registered_storage const &) = default;
+    registered_storage & operator=(registered_storage &&) = default;
+    registered_storage & operator=(registered_storage const &) = default;
+
+    void swap(registered_storage & other)
+    {
+        inner_.swap(other.inner_);
+        std::swap(id_, other.id_);
+    }
+
+    template <typename Derived, typename... Args>
+    Derived * emplace(Args &&... args)
+    {
+        Derived * result = inner_.template emplace<Derived>(std::forward<Args>(args)...);
+        id_ = type_registry<Base>::template id<Derived>();
+        return result;
+    }
+
+    Base * pointer()
+    {
+        return inner_.pointer();
+    }
+
+    Base const * pointer() const
+    {
+        return inner_.pointer();
+    }
+
+    int index() const
+    {
+        return static_cast<int>(id_);
+    }
+
+    private:
+
+    Inner inner_;
+    std::uint32_t id_;
+};
+
+#endif
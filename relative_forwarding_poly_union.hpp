@@ -0,0 +1,31 @@
+#ifndef RELATIVE_FORWARDING_POLY_UNION_HPP
+#define RELATIVE_FORWARDING_POLY_UNION_HPP
+
+#include "relative_forwarding_storage.hpp"
+#include "basic_poly_union.hpp"
+
+/**
+ * relative_forwarding_poly_union is a forwarding_poly_union that stores
+ * values which exceed the storage size in offset_arena<Base, Tag> and refers
+ * to them by a 32-bit offset.  It has exactly N bytes, i.e., it may be as
+ * small as a single vptr.  Every thread has its own arena, so values may not
+ * cross threads.  Use a distinct Tag per container to give it a separate
+ * arena.  Trivially relocatable hierarchies are movable even without
+ * polymorphic_movable.
+ */
+template <typename Base, int N, typename Tag = Base>
+using relative_forwarding_poly_union = basic_poly_union
+    < Base
+    , N
+    , relative_forwarding_storage<N, Base, Tag>
+    , void
+    , std::derived_from<Base, polymorphic_movable> || is_trivially_relocatable_hierarchy<Base>::value
+    >;
+
+template <typename Base, int N, typename Derived, typename... Args>
+relative_forwarding_poly_union<Base, N> make_relative_forwarding_poly_union(Args &&... args)
+{
+    return relative_forwarding_poly_union<Base, N>(std::type_identity<Derived>{}, std::forward<Args>(args)...);
+}
+
+#endif
@@ -0,0 +1,296 @@
+#ifndef RELATIVE_FORWARDING_STORAGE_HPP
+#define RELATIVE_FORWARDING_STORAGE_HPP
+
+#include <cassert>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+#include "basic_storage.hpp"
+#include "offset_arena.hpp"
+#include "trivially_relocatable.hpp"
+
+/**
+ * relative_forwarding_storage behaves like forwarding_storage, except that
+ * values that do not fit are stored in offset_arena<Base, Tag> instead of on
+ * the heap.
+ *
+ * A forwarded value is represented by a single 64-bit word at the start of
+ * the buffer: the offset in the upper and a tag in the lower half.  The tag
+ * has the lowest bit set, which is never the case for the vptr of a value in
+ * place, so no additional flag is needed and the storage is exactly N bytes,
+ * e.g., 8 bytes for stateless types with a rare large value.
+ *
+ * Forwarded values are not freed until the arena is compacted, which
+ * happens automatically when a value is forwarded and at least half of the
+ * arena was released, or with offset_arena::compact.
+ *
+ * The arena is shared by all storages of a thread with the same Base and
+ * Tag, each thread has its own.  Hence a storage with a forwarded value may
+ * not be used by another thread than the one that forwarded it, debug builds
+ * assert this.  A distinct Tag gives, e.g., a container its own arena to
+ * compact.  See offset_arena for details.
+ */
+template <int N, typename Base, typename Tag = Base>
+struct relative_forwarding_storage : basic_storage<N, Base>
+{
+    typedef offset_arena<Base, Tag> arena_type;
+
+    static_assert(N >= static_cast<int>(sizeof(std::uint64_t)), "The storage has to hold a 64-bit offset word");
+    static_assert(std::is_polymorphic_v<Base> && alignof(Base) >= alignof(std::uint64_t), "The vptr of Base has to be distinguishable from an offset word");
+
+    template <std::derived_from<Base> Derived, typename... Args>
+    relative_forwarding_storage(std::type_identity<Derived>, Args &&... args)
+    {
+        static_assert(sizeof(relative_forwarding_storage) == N, "N has to be a multiple of the alignment of Base");
+
+        construct<Derived>(std::forward<Args>(args)...);
+    }
+
+    ~relative_forwarding_storage()
+    {
+        destroy();
+    }
+
+    relative_forwarding_storage(relative_forwarding_storage && other) noexcept
+    {
+        move_construct(other);
+    }
+
+    relative_forwarding_storage(relative_forwarding_storage const & other)
+    {
+        std::uint64_t const word = other.word();
+        if (word == MovedFromWord)
+        {
+            set_word(word);
+        }
+        else if (is_forwarded(word))
+        {
+            arena_type & arena = arena_type::instance();
+            std::uint32_t const offset = arena.allocate(arena.block_size(offset_of(word)), owner());
+            set_word(forwarded_word(offset));
+            try
+            {
+                // Allocating may have compacted the arena and moved other.
+                super::copy_construct_in_place_base(arena.pointer(offset_of(other.word())), reinterpret_cast<std::byte *>(arena.pointer(offset)));
+            }
+            catch (...)
+            {
+                arena.release(offset);
+                throw;
+            }
+        }
+        else
+        {
+            super::copy_construct_in_place_base(other.pointer());
+        }
+    }
+
+    // Copies first, so this keeps its value if copying throws.
+    relative_forwarding_storage & operator=(relative_forwarding_storage const & other)
+    {
+        relative_forwarding_storage copy(other);
+        return *this = std::move(copy);
+    }
+
+    relative_forwarding_storage & operator=(relative_forwarding_storage && other) noexcept
+    {
+        if (this != &other)
+        {
+            destroy();
+            move_construct(other);
+        }
+        return *this;
+    }
+
+    // Swaps bytes for trivially relocatable hierarchies and moves through a
+    // temporary otherwise.
+    void swap(relative_forwarding_storage & other)
+    {
+        if constexpr (is_trivially_relocatable_hierarchy<Base>::value)
+        {
+            super::unsafe_swap_bytes(other);
+            update_owner();
+            other.update_owner();
+        }
+        else
+        {
+            relative_forwarding_storage tmp(std::move(other));
+            other = std::move(*this);
+            *this = std::move(tmp);
+        }
+    }
+
+    template <std::derived_from<Base> Derived, typename... Args>
+    Derived * emplace(Args &&... args)
+    {
+        destroy();
+        return construct<Derived>(std::forward<Args>(args)...);
+    }
+
+    bool is_forwarded() const
+    {
+        return is_forwarded(word());
+    }
+
+    Base * pointer()
+    {
+        std::uint64_t const w = word();
+        if (!is_forwarded(w))
+        {
+            return super::unsafe_base_pointer();
+        }
+        if (w == MovedFromWord)
+        {
+            return nullptr;
+        }
+        arena_type & arena = arena_type::instance();
+        assert(arena.is_owned_by(offset_of(w), owner()) && "value forwarded by another thread");
+        return arena.pointer(offset_of(w));
+    }
+
+    Base const * pointer() const
+    {
+        std::uint64_t const w = word();
+        if (!is_forwarded(w))
+        {
+            return super::unsafe_base_pointer();
+        }
+        if (w == MovedFromWord)
+        {
+            return nullptr;
+        }
+        arena_type const & arena = arena_type::instance();
+        assert(arena.is_owned_by(offset_of(w), owner()) && "value forwarded by another thread");
+        return arena.pointer(offset_of(w));
+    }
+
+    private:
+
+    typedef basic_storage<N, Base> super;
+
+    static std::uint64_t constexpr ForwardedTag = 1;
+    // A forwarded value that was moved from.
+    static std::uint64_t constexpr MovedFromWord = 3;
+
+    static bool is_forwarded(std::uint64_t word)
+    {
+        return (word & ForwardedTag) != 0;
+    }
+
+    static std::uint32_t offset_of(std::uint64_t word)
+    {
+        return static_cast<std::uint32_t>(word >> 32);
+    }
+
+    static std::uint64_t forwarded_word(std::uint32_t offset)
+    {
+        return (std::uint64_t(offset) << 32) | ForwardedTag;
+    }
+
+    std::byte * owner()
+    {
+        return super::template unsafe_pointer<std::byte>();
+    }
+
+    std::byte const * owner() const
+    {
+        return super::template unsafe_pointer<std::byte>();
+    }
+
+    std::uint64_t word() const
+    {
+        std::uint64_t result;
+        std::memcpy(&result, super::template unsafe_pointer<std::byte>(), sizeof(result));
+        return result;
+    }
+
+    void set_word(std::uint64_t word)
+    {
+        std::memcpy(owner(), &word, sizeof(word));
+    }
+
+    // Assumption: this holds no value.
+    void move_construct(relative_forwarding_storage & other) noexcept
+    {
+        std::uint64_t const word = other.word();
+        if constexpr (is_trivially_relocatable_hierarchy<Base>::value)
+        {
+            super::unsafe_copy_bytes(other.owner());
+            update_owner();
+            other.set_word(MovedFromWord);
+        }
+        else if (is_forwarded(word))
+        {
+            set_word(word);
+            if (word != MovedFromWord)
+            {
+                arena_type::instance().set_owner(offset_of(word), owner());
+            }
+            other.set_word(MovedFromWord);
+        }
+        else
+        {
+            super::move_construct_in_place_base(other.pointer());
+        }
+    }
+
+    void update_owner()
+    {
+        std::uint64_t const w = word();
+        if (is_forwarded(w) && w != MovedFromWord)
+        {
+            arena_type::instance().set_owner(offset_of(w), owner());
+        }
+    }
+
+    template <typename Derived, typename... Args>
+    Derived * construct(Args &&... args)
+    {
+        if constexpr (sizeof(Derived) <= N && alignof(Derived) <= alignof(Base))
+        {
+            return super::template unsafe_construct<Derived>(std::forward<Args>(args)...);
+        }
+        else
+        {
+            static_assert(alignof(Derived) <= arena_type::alignment, "Derived is over-aligned for offset_arena");
+            // The value is accessed through a Base pointer to its start.
+            static_assert(base_at_start<Derived, Base>, "Base has to be at the start of Derived");
+
+            arena_type & arena = arena_type::instance();
+            std::uint32_t const offset = arena.allocate(sizeof(Derived), owner());
+            set_word(forwarded_word(offset));
+            try
+            {
+                return ::new (static_cast<void *>(arena.pointer(offset))) Derived(std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                set_word(MovedFromWord);
+                arena.release(offset);
+                throw;
+            }
+        }
+    }
+
+    void destroy()
+    {
+        std::uint64_t const w = word();
+        if (!is_forwarded(w))
+        {
+            super::unsafe_destroy_base();
+        }
+        else if (w != MovedFromWord)
+        {
+            arena_type & arena = arena_type::instance();
+            assert(arena.is_owned_by(offset_of(w), owner()) && "value forwarded by another thread");
+            arena.pointer(offset_of(w))->~Base();
+            arena.release(offset_of(w));
+        }
+    }
+};
+
+#endif
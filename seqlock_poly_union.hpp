@@ -0,0 +1,138 @@
+#ifndef SEQLOCK_POLY_UNION_HPP
+#define SEQLOCK_POLY_UNION_HPP
+
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "bounded_storage.hpp"
+#include "trivially_copyable_except_vptr.hpp"
+
+/**
+ * seqlock_poly_union is a polymorphic slot for small values that are
+ * trivially copyable except for their vptr.  A single writer may replace the
+ * value while readers take a consistent copy into their own bounded_storage.
+ *
+ * The value is kept as a bitwise copy that is guarded by a version counter.
+ * Readers copy the bytes and retry if the version was odd or changed in
+ * between, hence the read path does not contain any atomic read-modify-write
+ * operations.  As with the other unions no additional pointer is stored.
+ *
+ * Since only bitwise copies are ever made, destructors of the stored types
+ * are never called.  Stored types have to be declared with
+ * DECLARE_TRIVIALLY_COPYABLE_EXCEPT_VPTR, which is checked at compile-time
+ * together with their size and alignment.  Calling emplace from more than one
+ * thread at a time is not permitted.
+ */
+template <typename Base, int N>
+requires storage_size_at_most<Base, N>
+struct seqlock_poly_union
+{
+    template <std::derived_from<Base> Derived, typename... Args>
+    seqlock_poly_union(std::type_identity<Derived>, Args &&... args)
+    {
+        emplace<Derived>(std::forward<Args>(args)...);
+    }
+
+    seqlock_poly_union(seqlock_poly_union const &) = delete;
+    seqlock_poly_union & operator=(seqlock_poly_union const &) = delete;
+
+    // Only a single thread may call emplace at a time.
+    template <std::derived_from<Base> Derived, typename... Args>
+    void emplace(Args &&... args)
+    {
+        static_assert(storage_size_at_most<Derived, N>, "seqlock_poly_union: Derived does not fit into N bytes");
+        static_assert(alignof(Derived) <= alignof(Base),
+                      "seqlock_poly_union: Derived is copied into storage that is aligned for Base");
+        static_assert(trivially_copyable_except_vptr<Derived>,
+                      "seqlock_poly_union: Derived is copied bitwise and never destroyed, declare it with "
+                      "DECLARE_TRIVIALLY_COPYABLE_EXCEPT_VPTR and list only trivially copyable poly_fields");
+
+        alignas(Base) std::byte bytes[sizeof(words_)] = {};
+        ::new (bytes) Derived(std::forward<Args>(args)...);
+
+        std::uint64_t const version = version_.load(std::memory_order_relaxed);
+        version_.store(version + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (std::size_t i = 0; i < WordCount; ++i)
+        {
+            word w;
+            std::memcpy(&w, bytes + i * sizeof(word), sizeof(word));
+            words_[i].store(w, std::memory_order_relaxed);
+        }
+
+        version_.store(version + 2, std::memory_order_release);
+    }
+
+    // Copy the current value into the given storage, replacing its value.
+    // While a write is in progress, the reader pauses for exponentially
+    // longer and eventually yields, in case the writer was preempted.
+    void read(bounded_storage<N, Base> & out) const
+    {
+        alignas(Base) std::byte bytes[sizeof(words_)];
+        int backoff = 1;
+        while (!try_copy(bytes))
+        {
+            if (backoff <= MaxBackoff)
+            {
+                for (int i = 0; i < backoff; ++i)
+                {
+                    pause();
+                }
+                backoff *= 2;
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+        out.unsafe_assign_bytes(bytes);
+    }
+
+    private:
+
+    static int constexpr MaxBackoff = 64;
+
+    static void pause()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+#endif
+    }
+
+    typedef std::uintptr_t word;
+
+    static std::size_t constexpr WordCount = (N + sizeof(word) - 1) / sizeof(word);
+
+    bool try_copy(std::byte * bytes) const
+    {
+        std::uint64_t const before = version_.load(std::memory_order_acquire);
+        if (before % 2 != 0)
+        {
+            return false;
+        }
+
+        for (std::size_t i = 0; i < WordCount; ++i)
+        {
+            word const w = words_[i].load(std::memory_order_relaxed);
+            std::memcpy(bytes + i * sizeof(word), &w, sizeof(word));
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return version_.load(std::memory_order_relaxed) == before;
+    }
+
+    std::atomic<std::uint64_t> version_ { 0 };
+    std::atomic<word> words_[WordCount];
+};
+
+#endif
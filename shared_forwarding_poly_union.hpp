@@ -0,0 +1,24 @@
+#ifndef SHARED_FORWARDING_POLY_UNION_HPP
+#define SHARED_FORWARDING_POLY_UNION_HPP
+
+#include "shared_forwarding_storage.hpp"
+#include "basic_poly_union.hpp"
+
+/**
+ * shared_forwarding_poly_union is a forwarding_poly_union whose values on the
+ * heap are shared between copies until they are modified.
+ *
+ * Only non-const access through pointer(), get(), or operator-> detaches a
+ * shared value, hence const access should be preferred where possible.  A
+ * value is not shared with later copies after such an access either.
+ */
+template <typename Base, int N>
+using shared_forwarding_poly_union = basic_poly_union<Base, N, shared_forwarding_storage<N, Base>>;
+
+template <typename Base, int N, typename Derived, typename... Args>
+shared_forwarding_poly_union<Base, N> make_shared_forwarding_poly_union(Args &&... args)
+{
+    return shared_forwarding_poly_union<Base, N>(std::type_identity<Derived>{}, std::forward<Args>(args)...);
+}
+
+#endif
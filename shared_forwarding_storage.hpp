@@ -0,0 +1,325 @@
+#ifndef SHARED_FORWARDING_STORAGE_HPP
+#define SHARED_FORWARDING_STORAGE_HPP
+
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "basic_storage.hpp"
+#include "trivially_relocatable.hpp"
+
+/**
+ * shared_forwarding_storage behaves like forwarding_storage, except that
+ * values on the heap are reference-counted and shared between copies.
+ * Copying such a value only increments the reference count.  The first
+ * non-const access of a shared value creates a private copy (copy-on-write),
+ * emplace simply drops the reference.  Values that fit the storage keep
+ * value semantics.
+ *
+ * The reference count is stored in front of the value in the same
+ * allocation, so sharing, detaching, and releasing a value never allocate
+ * more than once.  The count is atomic and a value is only modified after
+ * its uniqueness was observed with acquire ordering, hence copies may be
+ * used and destroyed by different threads.
+ *
+ * A pointer returned by a non-const access may still be used to modify the
+ * value after the storage was copied.  Such values are therefore no longer
+ * shared: copies made after a non-const access copy the value, until it is
+ * replaced with emplace.
+ */
+template <int N, typename Base>
+struct shared_forwarding_storage : basic_storage<N < int(sizeof(void *)) ? int(sizeof(void *)) : N, Base>
+{
+    template <std::derived_from<Base> Derived, typename... Args>
+    shared_forwarding_storage(std::type_identity<Derived>, Args &&... args)
+    {
+        bool constexpr new_one_fits = sizeof(Derived) <= MinimumN;
+
+        is_forwarded_ = !new_one_fits;
+        if constexpr (new_one_fits)
+        {
+            super::template unsafe_construct<Derived>(std::forward<Args>(args)...);
+        }
+        else
+        {
+            construct_forwarded<Derived>(std::forward<Args>(args)...);
+        }
+    }
+
+    ~shared_forwarding_storage()
+    {
+        destroy();
+    }
+
+    shared_forwarding_storage(shared_forwarding_storage && other) noexcept
+    {
+        move_construct(other);
+    }
+
+    shared_forwarding_storage(shared_forwarding_storage const & other)
+        : is_forwarded_(other.is_forwarded_)
+    {
+        if (other.is_forwarded_)
+        {
+            shared_block * block = other.unsafe_block_reference();
+            if (block->is_shareable)
+            {
+                block->references.fetch_add(1, std::memory_order_relaxed);
+            }
+            else
+            {
+                block = copy_block(*block);
+            }
+            super::template unsafe_construct<shared_block *>(block);
+        }
+        else
+        {
+            super::copy_construct_in_place_base(other.unsafe_base_pointer());
+        }
+    }
+
+    // Copies first, so this keeps its value if copying throws.
+    shared_forwarding_storage & operator=(shared_forwarding_storage const & other)
+    {
+        shared_forwarding_storage copy(other);
+        return *this = std::move(copy);
+    }
+
+    shared_forwarding_storage & operator=(shared_forwarding_storage && other) noexcept
+    {
+        if (this != &other)
+        {
+            destroy();
+            move_construct(other);
+        }
+        return *this;
+    }
+
+    // Swaps pointers if both values are forwarded, bytes for trivially
+    // relocatable hierarchies, and moves through a temporary otherwise.
+    void swap(shared_forwarding_storage & other)
+    {
+        if constexpr (is_trivially_relocatable_hierarchy<Base>::value)
+        {
+            super::unsafe_swap_bytes(other);
+            std::swap(is_forwarded_, other.is_forwarded_);
+        }
+        else
+        {
+            if (is_forwarded_ && other.is_forwarded_)
+            {
+                std::swap(unsafe_block_reference(), other.unsafe_block_reference());
+            }
+            else
+            {
+                shared_forwarding_storage tmp(std::move(other));
+                other = std::move(*this);
+                *this = std::move(tmp);
+            }
+        }
+    }
+
+    template <std::derived_from<Base> Derived, typename... Args>
+    Derived * emplace(Args &&... args)
+    {
+        bool constexpr new_one_fits = sizeof(Derived) <= MinimumN;
+        if (is_forwarded_)
+        {
+            if constexpr (new_one_fits)
+            {
+                is_forwarded_ = false;
+                release(unsafe_block_reference());
+                return super::template unsafe_construct<Derived>(std::forward<Args>(args)...);
+            }
+            else
+            {
+                shared_block * block = make_block<Derived>(std::forward<Args>(args)...);
+                release(std::exchange(unsafe_block_reference(), block));
+                return static_cast<Derived *>(block->value);
+            }
+        }
+        else
+        {
+            super::unsafe_destroy_base();
+            if constexpr (new_one_fits)
+            {
+                return super::template unsafe_construct<Derived>(std::forward<Args>(args)...);
+            }
+            else
+            {
+                is_forwarded_ = true;
+                return construct_forwarded<Derived>(std::forward<Args>(args)...);
+            }
+        }
+    }
+
+    // Detaches a shared value and stops sharing it with later copies.
+    Base * pointer()
+    {
+        if (is_forwarded_)
+        {
+            shared_block * & block = unsafe_block_reference();
+            if (block->references.load(std::memory_order_acquire) != 1)
+            {
+                release(std::exchange(block, copy_block(*block)));
+            }
+            block->is_shareable = false;
+            return block->value;
+        }
+        else
+        {
+            return super::unsafe_base_pointer();
+        }
+    }
+
+    Base const * pointer() const
+    {
+        if (is_forwarded_)
+        {
+            return unsafe_block_reference()->value;
+        }
+        else
+        {
+            return super::unsafe_base_pointer();
+        }
+    }
+
+    bool is_forwarded() const
+    {
+        return is_forwarded_;
+    }
+
+    // Whether the value is on the heap and shared with other copies.
+    bool is_shared() const
+    {
+        return is_forwarded_ && unsafe_block_reference()->references.load(std::memory_order_acquire) != 1;
+    }
+
+    private:
+
+    // Precedes the value in the same allocation.
+    struct shared_block
+    {
+        std::atomic<std::size_t> references;
+        Base * value;
+        std::uint32_t size;
+        bool is_shareable;
+    };
+
+    static std::size_t constexpr alignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+    static std::size_t constexpr HeaderSize = (sizeof(shared_block) + alignment - 1) / alignment * alignment;
+
+    static int constexpr MinimumN = N < int(sizeof(shared_block *)) ? int(sizeof(shared_block *)) : N;
+
+    typedef basic_storage<MinimumN, Base> super;
+
+    // Assumption: this holds no value.
+    void move_construct(shared_forwarding_storage & other) noexcept
+    {
+        is_forwarded_ = other.is_forwarded_;
+        if (other.is_forwarded_)
+        {
+            super::template unsafe_construct<shared_block *>(std::exchange(other.unsafe_block_reference(), nullptr));
+        }
+        else
+        {
+            super::move_construct_in_place_base(other.unsafe_base_pointer());
+        }
+    }
+
+    void destroy()
+    {
+        if (is_forwarded_)
+        {
+            release(unsafe_block_reference());
+        }
+        else
+        {
+            super::unsafe_destroy_base();
+        }
+    }
+
+    template <typename Derived, typename... Args>
+    static shared_block * make_block(Args &&... args)
+    {
+        static_assert(alignof(Derived) <= alignment, "Over-aligned values cannot be shared");
+
+        std::byte * memory = static_cast<std::byte *>(::operator new(HeaderSize + sizeof(Derived)));
+        Derived * value;
+        try
+        {
+            value = ::new (memory + HeaderSize) Derived(std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            ::operator delete(memory);
+            throw;
+        }
+        return ::new (memory) shared_block { { 1 }, value, static_cast<std::uint32_t>(sizeof(Derived)), true };
+    }
+
+    // A single reference to a copy of the value of block.
+    static shared_block * copy_block(shared_block const & block)
+    {
+        if constexpr (std::is_base_of_v<polymorphic_copyable, Base>)
+        {
+            std::byte const * const old_memory = reinterpret_cast<std::byte const *>(&block);
+            std::ptrdiff_t const base_offset = reinterpret_cast<std::byte const *>(block.value) - (old_memory + HeaderSize);
+
+            std::byte * memory = static_cast<std::byte *>(::operator new(HeaderSize + block.size));
+            try
+            {
+                polymorphic_copyable const & c = *block.value;
+                c.polymorphic_copy_construct_in_place(memory + HeaderSize);
+            }
+            catch (...)
+            {
+                ::operator delete(memory);
+                throw;
+            }
+            Base * value = std::launder(reinterpret_cast<Base *>(memory + HeaderSize + base_offset));
+            return ::new (memory) shared_block { { 1 }, value, block.size, true };
+        }
+        else
+        {
+            static_assert(std::is_base_of_v<polymorphic_copyable, Base>,
+                          "Copy-on-write requires that Base implements polymorphic_copyable");
+        }
+    }
+
+    static void release(shared_block * block)
+    {
+        if (block != nullptr && block->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            block->value->~Base();
+            block->~shared_block();
+            ::operator delete(block);
+        }
+    }
+
+    shared_block * & unsafe_block_reference()
+    {
+        return *super::template unsafe_pointer<shared_block *>();
+    }
+
+    shared_block * const & unsafe_block_reference() const
+    {
+        return *super::template unsafe_pointer<shared_block *>();
+    }
+
+    template <typename Derived, typename... Args>
+    Derived * construct_forwarded(Args &&... args)
+    {
+        shared_block * block = make_block<Derived>(std::forward<Args>(args)...);
+        super::template unsafe_construct<shared_block *>(block);
+        return static_cast<Derived *>(block->value);
+    }
+
+    bool is_forwarded_;
+};
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef TRIVIALLY_COPYABLE_EXCEPT_VPTR_HPP
+#define TRIVIALLY_COPYABLE_EXCEPT_VPTR_HPP
+
+#include <tuple>
+#include <type_traits>
+
+#include "poly_fields.hpp"
+
+/**
+ * A polymorphic class is never trivially copyable in the sense of the
+ * standard.  However, if all of its members are trivially copyable and its
+ * destructor does nothing, then a bitwise copy within the same process yields
+ * a valid object, including its vptr.  Since the compiler cannot check this,
+ * classes have to opt in with DECLARE_TRIVIALLY_COPYABLE_EXCEPT_VPTR.  The
+ * destructor is virtual and hence never trivial, but the members that a
+ * class lists with poly_fields are checked to be trivially copyable, which
+ * implies that they are trivially destructible.
+ */
+template <typename T>
+struct is_trivially_copyable_except_vptr : std::false_type
+{
+};
+
+template <typename T>
+constexpr bool has_trivially_copyable_poly_fields()
+{
+    if constexpr (has_poly_fields<T>)
+    {
+        return []<typename... Fields>(std::type_identity<std::tuple<Fields...>>)
+        {
+            return (true && ... && std::is_trivially_copyable_v<Fields>);
+        }(std::type_identity<poly_field_values<T>>{});
+    }
+    else
+    {
+        return true;
+    }
+}
+
+template <typename T>
+concept trivially_copyable_except_vptr = std::is_trivially_copyable_v<T>
+    || (is_trivially_copyable_except_vptr<T>::value && has_trivially_copyable_poly_fields<T>());
+
+#define DECLARE_TRIVIALLY_COPYABLE_EXCEPT_VPTR(T) \
+    template <> \
+    struct is_trivially_copyable_except_vptr<T> : std::true_type \
+    { \
+    };
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef TRIVIALLY_RELOCATABLE_HPP
+#define TRIVIALLY_RELOCATABLE_HPP
+
+#include <type_traits>
+
+/**
+ * A class hierarchy is trivially relocatable if every subclass of Base that
+ * is ever stored may be moved to a different address by copying its bytes
+ * without calling a constructor or destructor.  This is the case for most
+ * classes that do not store pointers into themselves.  The storage types may
+ * then swap and relocate values with memcpy instead of virtual move
+ * construction.  Since the compiler cannot check this, hierarchies have to
+ * opt in with DECLARE_TRIVIALLY_RELOCATABLE_HIERARCHY.
+ */
+template <typename Base>
+struct is_trivially_relocatable_hierarchy : std::false_type
+{
+};
+
+#define DECLARE_TRIVIALLY_RELOCATABLE_HIERARCHY(Base) \
+    template <> \
+    struct is_trivially_relocatable_hierarchy<Base> : std::true_type \
+    { \
+    };
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef TYPE_NAME_HPP
+#define TYPE_NAME_HPP
+
+#include <cstdlib>
+#include <string>
+#include <typeinfo>
+
+#if __has_include(<cxxabi.h>)
+#include <cxxabi.h>
+#endif
+
+/**
+ * The readable name of a type, e.g., for reports.  type_info::name() is
+ * mangled with the Itanium ABI of GCC and Clang, so it is demangled where
+ * <cxxabi.h> is available.  Otherwise the name is returned as is.
+ */
+inline std::string type_name(std::type_info const & type)
+{
+#if __has_include(<cxxabi.h>)
+    int status = 0;
+    if (char * demangled = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status))
+    {
+        std::string result(demangled);
+        std::free(demangled);
+        return result;
+    }
+#endif
+    return type.name();
+}
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef TYPE_REGISTRY_HPP
+#define TYPE_REGISTRY_HPP
+
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <mutex>
+#include <typeinfo>
+#include <vector>
+
+/**
+ * type_registry assigns a dense integer id to every subclass of Base in the
+ * order of registration, starting with 0.  Unlike the position of a type in
+ * closed_poly_union, it works for open hierarchies, e.g., with subclasses
+ * from plugins.  The ids may be used to index per-type tables.
+ *
+ * Types are registered with REGISTER_POLYMORPHIC_TYPE at namespace scope,
+ * which assigns the id during static initialization.  A type that is not
+ * registered gets its id on first use.  Hence tables that are sized with
+ * size() should only be created after static initialization, and all types
+ * that are used afterwards should be registered.
+ *
+ * Registration takes constant time per type.  The total time spent is
+ * available from registration_time().  Ids are not stable between different
+ * programs or runs.
+ */
+template <typename Base>
+struct type_registry
+{
+    template <std::derived_from<Base> Derived>
+    static int id()
+    {
+        static int const value = add(typeid(Derived));
+        return value;
+    }
+
+    static int size()
+    {
+        return count().load(std::memory_order_acquire);
+    }
+
+    static std::type_info const & type(int id)
+    {
+        std::lock_guard<std::mutex> lock(data().mutex);
+        return *data().types[id];
+    }
+
+    static std::chrono::nanoseconds registration_time()
+    {
+        std::lock_guard<std::mutex> lock(data().mutex);
+        return data().time;
+    }
+
+    private:
+
+    struct registry_data
+    {
+        std::mutex mutex;
+        std::vector<std::type_info const *> types;
+        std::chrono::nanoseconds time { 0 };
+    };
+
+    static std::atomic<int> & count()
+    {
+        static std::atomic<int> c { 0 };
+        return c;
+    }
+
+    static registry_data & data()
+    {
+        static registry_data d;
+        return d;
+    }
+
+    static int add(std::type_info const & type)
+    {
+        auto const start = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(data().mutex);
+        int const result = static_cast<int>(data().types.size());
+        data().types.push_back(&type);
+        count().store(result + 1, std::memory_order_release);
+        data().time += std::chrono::steady_clock::now() - start;
+        return result;
+    }
+};
+
+#define POLY_UNION_CONCAT_IMPL(a, b) a##b
+#define POLY_UNION_CONCAT(a, b) POLY_UNION_CONCAT_IMPL(a, b)
+
+#define REGISTER_POLYMORPHIC_TYPE(Base, Derived) \
+    [[maybe_unused]] static int const POLY_UNION_CONCAT(poly_union_type_registration_, __COUNTER__) = \
+        type_registry<Base>::template id<Derived>();
+
+#endif
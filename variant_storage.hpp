@@ -0,0 +1,67 @@
+#ifndef VARIANT_STORAGE_HPP
+#define VARIANT_STORAGE_HPP
+
+#include <concepts>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#include "closed_poly_union.hpp"
+
+/**
+ * variant_storage stores one of a closed set of subclasses in a std::variant
+ * instead of a byte buffer.  Unlike placement new into a buffer this is
+ * allowed during constant evaluation, hence values may be constructed, and
+ * even used through constexpr virtual functions, at compile-time.  Copy and
+ * move construction use the constructors of the concrete types directly and
+ * do not require polymorphic_movable or polymorphic_copyable.
+ *
+ * The access to Base goes through std::visit, which is a table lookup at
+ * run-time, whereas the other storage types only return their buffer.
+ */
+template <typename Base, std::derived_from<Base>... Derived>
+struct variant_storage
+{
+    template <typename T, typename... Args>
+    requires is_member<T, Derived...>
+    constexpr variant_storage(std::type_identity<T>, Args &&... args)
+        : value_(std::in_place_type<T>, std::forward<Args>(args)...)
+    {
+    }
+
+    constexpr void swap(variant_storage & other)
+    {
+        value_.swap(other.value_);
+    }
+
+    template <typename T, typename... Args>
+    requires is_member<T, Derived...>
+    constexpr T * emplace(Args &&... args)
+    {
+        return &value_.template emplace<T>(std::forward<Args>(args)...);
+    }
+
+    constexpr Base * pointer()
+    {
+        return std::visit([](Base & v) { return &v; }, value_);
+    }
+
+    constexpr Base const * pointer() const
+    {
+        return std::visit([](Base const & v) { return &v; }, value_);
+    }
+
+    static int constexpr type_count = sizeof...(Derived);
+
+    // position of the current type in Derived
+    constexpr int index() const
+    {
+        return static_cast<int>(value_.index());
+    }
+
+    private:
+
+    std::variant<Derived...> value_;
+};
+
+#endif